@@ -1,13 +1,23 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 extern "C" {
@@ -15,2061 +25,1196 @@ extern "C" {
 #include <cairo-pdf.h>
 }
 
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "display_list.h"
+#include "pdf_writer.h"
+#include "png_writer.h"
+#include "skullbat.h"
+#include "stats.h"
+#include "svg_writer.h"
 #include "text.h"
+#include "trace.h"
 
 using namespace std;
 
-void die(string message) {
-    cout << message << endl;
-    exit(1);
-}
-
-float nan() {
-    // presence is not checked explicitly, exception thrown if use is attempted
-    return numeric_limits<float>::signaling_NaN();
+// Typesets the book at input a paragraph at a time as it is read, so only
+// one paragraph is held at once.  Returns the number of pages.
+int render_serial(string input, string filename) {
+    target_t tgt(filename);
+    tgt.new_page();
+    {
+        typesetter_t ts(tgt);
+        para_reader_t reader(input);
+        para_t para;
+        while (reader.next(para)) ts.typeset(para);
+    }
+    tgt.save_and_close();
+    return tgt.page_number;
 }
 
-const float POINTS_PER_INCH = 72.0;
-
-struct skullbat_context_t;
-struct skullbat_justification_context_t;
-struct target_t {
-    cairo_surface_t * csurf;
-
-    float paper_width;
-    float paper_height;
-
-    float margin;
-
-    skullbat_context_t * pn;   // for rendering page number
-    int page_number = 0;
-
-    set<skullbat_justification_context_t *> sbj_contexts;
-
-    target_t(string filename, float newwidth=5.5, float newheight=8.5,
-             float newmargin=1.0);
-
-    void new_page_subscribe(skullbat_justification_context_t * sbj);
-    void new_page_unsubscribe(skullbat_justification_context_t * sbj);
-
-    void new_page();
-    void mark_page_number();
-
-    void save_and_close();
-
-};
-
-struct vowel_space_t {
-    float before;
-    float after;
-};
-
-struct skullbat_context_t {
-    target_t & target;
-    cairo_t * cr;
-
-    float scale;
 
-    float unit;
-    float word_width;
+// A run of paragraphs starting at a chapter heading (or at the start of the
+// book).  Every heading begins a new page with all contexts back at their
+// first row, so a segment's layout depends only on where it starts.
+struct segment_t {
+    size_t first;
+    size_t last;
 
-    float step;
-    float halfstep;
-    float ribstep;
-    float vowelstep;
-    float wordstep;
+    int pages;
+    bool flips[3];   // whether title, chap, text emphasis toggles an odd number of times
 
-    float elstep;
-    float eldx;
+    int start_page;   // page before the segment's first page
+    bool emphasis[3];
 
-    float hookrad;
-    float dotrad;
-    float voicedlen;
-
-    float vowel_size;
-
-    float leftx;
-    float spinex;
-    float rightx;
-    float markx;
-
-    float starty;
-    float riby;
-
-    bool emphasis = false;
-
-    skullbat_context_t(target_t & newtgt, float newscale=1.0)
-            : target(newtgt) {
-
-        cr = cairo_create(target.csurf);
-        cairo_scale(cr, POINTS_PER_INCH, POINTS_PER_INCH);
-
-        cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-        cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
-        cairo_set_source_rgb(cr, 0,0,0);
-
-        set_skullbat_scale(newscale);
-    }
-
-    ~skullbat_context_t() {
-        cairo_destroy(cr);
-    }
-
-    void set_skullbat_scale(float newscale);
-    void render_at_inches(string text, float x, float y);
-    void render_voice_mark(float offset);
-    float size_consonant(char c);
-    void render_consonant(char c);
-    vowel_space_t vowel_space(char c);
-    float size_vowel_hook();
-    void render_vowel_hook();
-    void render_monopthong(char c, float x, float y);
-    void render_i_dipthong(char c, float x, float y);
-    void render_u_dipthong(char c, float x, float y);
-    float size_logogram_word(string w);
-    void render_logogram_word(string w);
-    float size_vowel_word(string w);
-    void render_vowel_word(string w);
-    float size_digit(char c);
-    void render_digit(char c);
-    float size_numeral(string w);
-    void render_numeral(string w);
-    void render_vowel(string v, float x, float y);
-    float size_punct(string w);
-    void render_punct(string w);
-    float size_phonetic_word(string w);
-    void render_phonetic_word(string w);
-    void render_phonetic_words(vector<string> & ws);
+    collect_sink_t output;
+    bool done = false;
 };
 
-using sb_t = skullbat_context_t;
-
-struct skullbat_justification_context_t : skullbat_context_t {
-    const float SEP_LINE_WIDTH = 0.01/2;
-    const float COLUMN_SPACING = 1.25;
-
-    cairo_t * scr;   // separator cairo context
-
-    float rows_per_page;
-    float inner_row_height;
-    float column_height;
-
-    float colstep;
-    int ncols;
-
-    bool need_fresh_column;
-
-    // these are origin 1
-    int cur_col;
-    int cur_row;
-
-    skullbat_justification_context_t(target_t & newtgt, float newscale=1.0,
-                                     int newrows=2)
-            : skullbat_context_t(newtgt, newscale) {
-        newtgt.new_page_subscribe(this);
-
-        scr = cairo_create(target.csurf);
-        cairo_scale(scr, POINTS_PER_INCH, POINTS_PER_INCH);
-        cairo_set_line_width(scr, SEP_LINE_WIDTH);
-        cairo_set_line_cap(scr, CAIRO_LINE_CAP_SQUARE);
-        cairo_set_line_join(scr, CAIRO_LINE_JOIN_ROUND);
-        cairo_set_source_rgb(scr, 0.5,0.5,0.5);
-
-        set_column_scale(newscale);
-        set_row_count(newrows);
-        first_row();
-    }
-
-    ~skullbat_justification_context_t() {
-        target.new_page_unsubscribe(this);
-        cairo_destroy(scr);
+vector<segment_t> split_segments(vector<para_t> & book) {
+    vector<segment_t> segs(1);
+    segs.back().first = 0;
+    for (size_t ix = 0; ix < book.size(); ix += 1) {
+        if (book[ix].kind == HEADING_PARA && ix > 0) {
+            segs.back().last = ix;
+            segs.push_back(segment_t());
+            segs.back().first = ix;
+        }
     }
-
-    void set_column_scale(float newscale);
-    void set_row_count(int newrows);
-    void set_column(int newcol);
-    void next_column();
-    void render_row_separator(int row);
-    void first_row();
-    void next_row();
-    void handle_new_page();
-    void render_column_divider();
-    void render_columns(string text);
-};
-
-using sbj_t = skullbat_justification_context_t;
-
-target_t::target_t(string filename, float newwidth, float newheight,
-                   float newmargin) {
-    paper_width = newwidth;
-    paper_height = newheight;
-    margin = newmargin;
-
-    csurf = cairo_pdf_surface_create(
-        filename.c_str(),
-        paper_width * POINTS_PER_INCH,
-        paper_height * POINTS_PER_INCH);
-
-    pn = new skullbat_context_t(* this);
-
-    new_page();
+    segs.back().last = book.size();
+    return segs;
 }
 
-void target_t::new_page_subscribe(sbj_t * sbj) {
-    sbj_contexts.insert(sbj);
-}
+void typeset_segment(target_t & tgt, vector<para_t> & book, segment_t & seg,
+                     bool emphasis[3]) {
+    // measured segments count their pages from 1
+    TRACE_SPAN(tgt.kind == MEASURE_TARGET ? "measure segment" : "segment",
+               tgt.page_number + 1);
+    typesetter_t ts(tgt);
+    ts.title.emphasis = emphasis[0];
+    ts.chap.emphasis = emphasis[1];
+    ts.text.emphasis = emphasis[2];
 
-void target_t::new_page_unsubscribe(sbj_t * sbj) {
-    sbj_contexts.erase(sbj);
-}
-
-void target_t::new_page() {
-    page_number += 1;
-
-    if (page_number > 1) cairo_surface_show_page(csurf);
-
-    mark_page_number();
-
-    for (sbj_t * sbj : sbj_contexts) sbj->handle_new_page();
-}
-
-bool even(int n) {
-    return n % 2 == 0;
-}
-
-void target_t::mark_page_number() {
-    string text = to_string(page_number);
-    float x = even(page_number) ? margin/2 : paper_width - margin/2;
-    float y = margin/2;
-    pn->render_at_inches(text, x, y);
-}
+    // the front matter is the only segment that doesn't open its own page
+    if (seg.first == 0) tgt.new_page();
 
-void target_t::save_and_close() {
-    cairo_surface_show_page(csurf);
+    for (size_t ix = seg.first; ix < seg.last; ix += 1) ts.typeset(book[ix]);
 
-    cairo_surface_finish(csurf);
-    cairo_surface_destroy(csurf);
+    seg.flips[0] = ts.title.emphasis != emphasis[0];
+    seg.flips[1] = ts.chap.emphasis != emphasis[1];
+    seg.flips[2] = ts.text.emphasis != emphasis[2];
 }
 
-void sb_t::set_skullbat_scale(float newscale) {
-    scale = newscale;
-
-    cairo_set_line_width(cr, scale*0.01/2);
-
-    unit = scale/5.0;
-    word_width = unit;
-
-    step = unit/4;
-    halfstep = step/2;
-    ribstep = 2*step/3;
-    vowelstep = ribstep;
-    wordstep = step;
-
-    elstep = 2*step / sqrt(5);
-    eldx = elstep;
-
-    hookrad = 2*halfstep/3;
-    dotrad = 2*halfstep/5;
-    voicedlen = 2*step/3;
-
-    vowel_size = halfstep + 2*dotrad;
-}
-
-void sbj_t::set_column_scale(float newscale) {
-    float row_width = target.paper_width - target.margin*2;
-
-    ncols = row_width / (word_width * COLUMN_SPACING);
-    colstep = row_width / ncols;
-}
-
-void sbj_t::set_row_count(int newrows) {
-    rows_per_page = newrows;
-    inner_row_height = (target.paper_height - target.margin) / rows_per_page;
-    column_height = inner_row_height - target.margin;
+void for_each_parallel(int njobs, size_t n, function<void(size_t)> fn) {
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    for (int jx = 0; jx < njobs; jx += 1) {
+        workers.emplace_back([&] {
+            for (size_t ix = next++; ix < n; ix = next++) fn(ix);
+        });
+    }
+    for (thread & worker : workers) worker.join();
 }
 
-//TODO unify setting x and y skullbat rendering positions
-void sbj_t::set_column(int newcol) {
-    cur_col = newcol;
+void render_parallel(vector<para_t> & book, string filename, int njobs) {
+    vector<segment_t> segs = split_segments(book);
 
-    spinex = target.margin + word_width/2 + (cur_col-1)*colstep;
-    leftx = spinex - step;
-    rightx = spinex + step;
-    markx = rightx + halfstep;
+    // lay out every segment on its own to learn its page count
+    for_each_parallel(njobs, segs.size(), [&](size_t ix) {
+        target_t tgt(MEASURE_TARGET);
+        bool emphasis[3] = {false, false, false};
+        typeset_segment(tgt, book, segs[ix], emphasis);
+        segs[ix].pages = tgt.page_number;
+    });
 
-    starty = target.margin + inner_row_height * (cur_row-1);
-    riby = starty;
+    // prefix sums give each segment its starting page and emphasis
+    int page_number = 0;
+    bool emphasis[3] = {false, false, false};
+    for (segment_t & seg : segs) {
+        seg.start_page = page_number;
+        page_number += seg.pages;
+        for (int ix = 0; ix < 3; ix += 1) {
+            seg.emphasis[ix] = emphasis[ix];
+            emphasis[ix] = emphasis[ix] != seg.flips[ix];
+        }
+    }
 
-    need_fresh_column = false;
-}
+    // render concurrently, writing each segment's pages as soon as all the
+    // segments before it are written
+    mutex done_mutex;
+    condition_variable done_cond;
 
-void sbj_t::next_column() {
-    if (cur_col + 1 > ncols) next_row();
-    else set_column(cur_col + 1);
-}
+    thread writer([&] {
+        unique_ptr<page_sink_t> out(open_sink(filename));
+        for (segment_t & seg : segs) {
+            unique_lock<mutex> lock(done_mutex);
+            done_cond.wait(lock, [&] { return seg.done; });
+            lock.unlock();
 
-void sbj_t::render_row_separator(int row) {
-    float sepy = target.margin/2 + inner_row_height * (row-1);
-    cairo_move_to(scr, target.margin, sepy);
-    cairo_line_to(scr, target.paper_width - target.margin, sepy);
-    cairo_stroke(scr);
+            TRACE_SPAN("write segment", seg.start_page + 1);
+            for (recorded_page_t & page : seg.output.pages) out->add_page(page);
+            seg.output.pages.clear();
+        }
+        out->finish();
+    });
+
+    for_each_parallel(njobs, segs.size(), [&](size_t ix) {
+        segment_t & seg = segs[ix];
+        target_t tgt(RECORD_TARGET, & seg.output);
+        tgt.page_number = seg.start_page;
+        typeset_segment(tgt, book, seg, seg.emphasis);
+        tgt.save_and_close();
+
+        lock_guard<mutex> lock(done_mutex);
+        seg.done = true;
+        done_cond.notify_all();
+    });
+
+    writer.join();
 }
 
-void sbj_t::first_row() {
-    cur_row = 1;
-    set_column(1);
-}
+struct chapter_stats_t {
+    int chapter;   // 0 for the front matter
+    int first_page;
+    int last_page;
+    int rows;
+    int columns;
+    int words;
+};
 
-void sbj_t::next_row() {
-    cur_row += 1;
+// Lays the book out on a measuring target and prints one tab separated line
+// per chapter.  Nothing is drawn and no cairo surface is created.
+void print_layout_stats(vector<para_t> & book, ostream & out) {
+    target_t tgt(MEASURE_TARGET);
+    typesetter_t ts(tgt);
+
+    vector<chapter_stats_t> stats;
+    sbj_t * contexts[3] = {& ts.title, & ts.chap, & ts.text};
+    auto count = [&](int sign) {
+        chapter_stats_t & cs = stats.back();
+        for (sbj_t * sbj : contexts) {
+            cs.rows += sign * sbj->rows_filled;
+            cs.columns += sign * sbj->columns_filled;
+            cs.words += sign * sbj->words_placed;
+        }
+    };
 
-    if (cur_row > rows_per_page) {
-        target.new_page();
-        first_row();
+    tgt.new_page();
+    stats.push_back({0, 1, 1, 0, 0, 0});
+    for (para_t & para : book) {
+        if (para.kind == HEADING_PARA || para.kind == KEY_PAGE) {
+            count(+1);
+            if (para.kind == KEY_PAGE) break;
+            stats.push_back({stats.back().chapter + 1, tgt.page_number + 1,
+                             0, 0, 0, 0});
+            count(-1);
+        }
+        ts.typeset(para);
+        stats.back().last_page = tgt.page_number;
     }
-    else {
-        render_row_separator(cur_row);
-        set_column(1);
+
+    out << "chapter\tfirst_page\tlast_page\tpages\trows\tcolumns\twords" << endl;
+    for (chapter_stats_t & cs : stats) {
+        out << cs.chapter << "\t" << cs.first_page << "\t" << cs.last_page
+            << "\t" << cs.last_page - cs.first_page + 1 << "\t" << cs.rows
+            << "\t" << cs.columns << "\t" << cs.words << endl;
     }
-}
 
-void sbj_t::handle_new_page() {
-    first_row();
+    // the key page follows the last chapter
+    out << "total\t1\t" << tgt.page_number + 1 << "\t" << tgt.page_number + 1
+        << "\t\t\t" << endl;
 }
 
-void sb_t::render_voice_mark(float offset=0.0) {
-    cairo_move_to(cr, markx, riby - voicedlen/2 + offset);
-    cairo_line_to(cr, markx, riby + voicedlen/2 + offset);
+uint64_t para_hash(const para_t & para) {
+    return hash_bytes(para.text, FNV_OFFSET ^ para.kind);
 }
 
-float sb_t::size_consonant(char c) {
-    float size = 0;
-
-    switch (c) {
-    case 'b':
-    case 'p':
-        break;
-    case 'v':
-    case 'f':
-        size += halfstep;
-        break;
-    case 'D':
-    case 'T':
-        size += halfstep;
-        break;
-    case 'd':
-    case 't':
-        break;
-    case 'j':
-    case 'c':
-        size += ribstep/2;
-        size += halfstep;
-        break;
-    case 'z':
-    case 's':
-        size += halfstep;
-        break;
-    case 'Z':
-    case 'S':
-        size += halfstep;
-        break;
-    case 'g':
-    case 'k':
-        break;
-    case 'h':
-        size += halfstep;
-        break;
-    case 'w':
-        size += halfstep;
-        break;
-    case 'l':
-    case 'r':
-        size += elstep;
-        break;
-    case 'y':
-        size += halfstep;
-        break;
-    case 'm':
-    case 'n':
-    case 'N':
-        size += 3*step/4;
-        break;
-    default:
-        // unimplemented letter
-        size += step;
-        break;
+uint64_t dictionary_hash() {
+    uint64_t hash = FNV_OFFSET;
+    for (auto & entry : pronunciation) {
+        hash = hash_bytes(entry.first, hash);
+        hash = hash_bytes(entry.second, hash);
     }
-
-    return size;
+    return hash;
 }
 
-struct point_t {
-    float x;
-    float y;
+struct para_record_t {
+    uint64_t hash;
+    layout_state_t before;
+    layout_state_t after;
+    vector<float> token_sizes;
 };
 
-point_t r_rotate(point_t p0) {
-    point_t p;
-    float u = 1.0/sqrt(5);
-    p.x = p0.x * -2*u + p0.y * -u;
-    p.y = p0.x * u + p0.y * -2*u;
-    return p;
-}
+// What the last run laid out and drew, kept next to the pdf so that a rerun
+// only has to redo the pages a change touches.
+const uint32_t CACHE_MAGIC = 0x4342534b;   // "KSBC"
+const uint32_t CACHE_VERSION = 1;
 
-void sb_t::render_consonant(char c) {
-    switch (c) {
-    case 'b':
-        render_voice_mark();
-    case 'p':
-        cairo_move_to(cr, spinex, riby);
-        cairo_line_to(cr, rightx, riby);
-        break;
-    case 'v':
-        render_voice_mark(halfstep/2);
-    case 'f':
-        cairo_move_to(cr, spinex, riby);
-        /*
-        cairo_line_to(cr, rightx, riby);
-        cairo_rel_line_to(cr, -halfstep/2, halfstep);
-        */
-        cairo_rel_line_to(cr, 3*step/6, 0);
-        cairo_rel_curve_to(cr, 2*step/3,0, 2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        break;
-    case 'D':
-        render_voice_mark(halfstep/2);
-    case 'T':
-        cairo_move_to(cr, spinex, riby);
-        cairo_line_to(cr, rightx, riby);
-        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        break;
-    case 'd':
-        render_voice_mark();
-    case 't':
-        cairo_move_to(cr, leftx, riby);
-        cairo_line_to(cr, rightx, riby);
-        break;
-    case 'j':
-        render_voice_mark(halfstep/2+ribstep/4);
-    case 'c':
-        cairo_move_to(cr, rightx, riby);
-        cairo_line_to(cr, leftx, riby);
-        riby += ribstep/2;
-        cairo_move_to(cr, leftx, riby);
-        cairo_line_to(cr, rightx, riby);
-        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        break;
-    case 'z':
-        render_voice_mark(halfstep/2);
-    case 's':
-        cairo_move_to(cr, leftx, riby);
-        /*
-        cairo_line_to(cr, rightx, riby);
-        cairo_rel_line_to(cr, -halfstep/2, halfstep);
-        */
-        cairo_rel_line_to(cr, 9*step/6, 0);
-        cairo_rel_curve_to(cr, 2*step/3,0, 2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        break;
-    case 'Z':
-        render_voice_mark(halfstep/2);
-    case 'S':
-        cairo_move_to(cr, leftx, riby);
-        cairo_line_to(cr, rightx, riby);
-        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        break;
-    case 'g':
-        render_voice_mark();
-    case 'k':
-        cairo_move_to(cr, leftx, riby);
-        cairo_line_to(cr, spinex, riby);
-        break;
-    case 'h':
-        cairo_move_to(cr, leftx, riby);
-        cairo_line_to(cr, spinex, riby);
-        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        break;
-    case 'w':
-        cairo_move_to(cr, rightx, riby);
-        riby += halfstep;
-        cairo_line_to(cr, spinex, riby);
-        break;
-    case 'l':
-        cairo_move_to(cr, spinex+eldx, riby);
-        riby += elstep;
-        cairo_line_to(cr, spinex-eldx, riby);
-        break;
-    case 'r':
-        cairo_move_to(cr, spinex+eldx, riby);
-        riby += elstep;
-        cairo_line_to(cr, spinex-eldx, riby);
-        //cairo_rel_curve_to(cr, elstep/2,-halfstep, elstep,0, 0,halfstep);
-        //cairo_rel_curve_to(cr, halfstep,-elstep/2, 0,-elstep, -halfstep,0);
-        {
-            point_t p_a = r_rotate({-2*step/3, 0});
-            point_t p_b = r_rotate({-2*step/3, halfstep});
-            point_t p_c = r_rotate({0, halfstep});
-            cairo_rel_curve_to(cr, p_a.x,p_a.y, p_b.x,p_b.y, p_c.x,p_c.y);
-        }
-        break;
-    case 'y':
-        cairo_move_to(cr, spinex, riby);
-        riby += halfstep;
-        cairo_line_to(cr, leftx, riby);
-        break;
-    case 'm':
-        riby += 3*step/4;
-        cairo_move_to(cr, spinex, riby);
-        cairo_rel_curve_to(cr, 0,-step, step,-step, step,0);
-        break;
-    case 'n':
-        riby += 3*step/4;
-        cairo_move_to(cr, spinex-halfstep, riby);
-        cairo_rel_curve_to(cr, 0,-step, step,-step, step,0);
-        break;
-    case 'N':
-        riby += 3*step/4;
-        cairo_move_to(cr, leftx, riby);
-        cairo_rel_curve_to(cr, 0,-step, step,-step, step,0);
-        break;
-    default:
-        // unimplemented letter
-        cout << "unimplemented consonant: " << c << endl;
-        riby += halfstep;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex,riby, halfstep, 0,2*M_PI);
-        riby += halfstep;
-        break;
-    }
-}
+struct layout_cache_t {
+    uint64_t dict_hash = 0;
+    vector<para_record_t> paras;
+    vector<recorded_page_t> pages;
 
-struct fills_t {
-    bool l_top;
-    bool c_top;
-    bool r_top;
-    bool l_bot;
-    bool c_bot;
-    bool r_bot;
+    bool load(string filename, bool with_pages=true);
+    void save(string filename);
 };
 
-fills_t consonant_fills(char c) {
-    switch (c) {
-    case 'b':
-    case 'p':
-        return {false, true, true, false, true, true};
-        break;
-    case 'v':
-    case 'f':
-        return {false, true, true, false, false, true};
-        break;
-    case 'D':
-    case 'T':
-        return {false, true, true, false, false, true};
-        break;
-    case 'd':
-    case 't':
-        return {true, true, true, true, true, true};
-        break;
-    case 'j':
-    case 'c':
-        return {true, true, true, false, false, true};
-        break;
-    case 'z':
-    case 's':
-        return {true, true, true, false, false, true};
-        break;
-    case 'Z':
-    case 'S':
-        return {true, true, true, false, false, true};
-        break;
-    case 'g':
-    case 'k':
-        return {true, true, false, true, true, false};
-        break;
-    case 'h':
-        return {true, true, false, true, true, false};
-        break;
-    case 'w':
-        return {false, false, true, false, true, false};
-        break;
-    case 'l':
-        return {false, false, true, true, false, false};
-        break;
-    case 'r':
-        return {false, false, true, true, false, false};
-        break;
-    case 'y':
-        return {false, true, false, true, false, false};
-        break;
-    case 'm':
-        return {false, false, true, false, true, true};
-        break;
-    case 'n':
-        return {false, true, false, true, true, true};
-        break;
-    case 'N':
-        return {true, false, false, true, true, false};
-        break;
-    case '`':
-        return {true, true, false, true, true, false};
-        break;
-    default:
-        // unimplemented letter
-        cout << "unimplemented consonant fill: " << c << endl;
-        return {false, true, false, false, true, false};
-        break;
-    }
-}
+// the paragraph records come first, so they can be read without the pages
+bool layout_cache_t::load(string filename, bool with_pages) {
+    ifstream in(filename, ios::binary);
+    uint32_t magic, version;
+    if (! read_pod(in, magic) || magic != CACHE_MAGIC) return false;
+    if (! read_pod(in, version) || version != CACHE_VERSION) return false;
+    if (! read_pod(in, dict_hash)) return false;
 
-vowel_space_t sb_t::vowel_space(char c) {
-    switch (c) {
-    case 'b':
-    case 'p':
-    case 'd':
-    case 't':
-    case 'g':
-    case 'k':
-        return {0,0};
-        break;
-    case 'v':
-    case 'f':
-    case 'z':
-    case 's':
-        return {0,0};
-        break;
-    case 'j':
-    case 'c':
-        return {0,0};
-        break;
-    case 'D':
-    case 'T':
-    case 'Z':
-    case 'S':
-        return {0,0};
-        break;
-    case 'h':
-        return {0,halfstep/2};
-        break;
-    case 'w':
-        return {0,0};
-        break;
-    case 'l':
-    case 'r':
-        return {0,elstep};
-        break;
-    case 'y':
-        return {0,step};
-        break;
-    case 'm':
-    case 'n':
-    case 'N':
-        return {step/4,0};
-        break;
-    case '`':
-        return {0,halfstep};
-        break;
-    default:
-        cout << "unimplemented vowel space: " << c << endl;
-        return {0,0};
-        break;
+    uint64_t n;
+    if (! read_pod(in, n)) return false;
+    paras.resize(n);
+    for (para_record_t & rec : paras) {
+        if (! read_pod(in, rec.hash)) return false;
+        if (! read_pod(in, rec.before)) return false;
+        if (! read_pod(in, rec.after)) return false;
+        if (! read_pods(in, rec.token_sizes)) return false;
     }
-}
-
-float sb_t::size_vowel_hook() {
-    return halfstep;
-}
-
-void sb_t::render_vowel_hook() {
-    cairo_new_sub_path(cr);
-    cairo_arc(cr, spinex-halfstep,riby, halfstep, 2*M_PI,M_PI);
-    riby += halfstep;
-}
 
-void sb_t::render_monopthong(char c, float x, float y) {
-    switch (c) {
-    case 'i':   // seat
-        x += halfstep/2 /2;
-        y += halfstep * sqrt(3)/2 /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, -halfstep/2, -halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-        break;
-    case 'I':   // sit
-        x += halfstep * sqrt(3)/2 /2;
-        y += halfstep/2 /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, -halfstep * sqrt(3)/2, -halfstep/2);
-        cairo_stroke(cr);
-        break;
-    case 'e':   // sate
-        x += halfstep /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, -halfstep, 0);
-        cairo_stroke(cr);
-        break;
-    case 'E':   // set
-        x += halfstep * sqrt(3)/2 /2;
-        y -= halfstep/2 /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, -halfstep * sqrt(3)/2, +halfstep/2);
-        cairo_stroke(cr);
-        break;
-    case 'A':   // sat
-        x += halfstep/2 /2;
-        y -= halfstep * sqrt(3)/2 /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, -halfstep/2, halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-        break;
-    case 'a':   // sot
-        y -= halfstep /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, 0, halfstep);
-        cairo_stroke(cr);
-        break;
-    case 'O':   // caught, if you don't merge with cot
-        x -= halfstep/2 /2;
-        y -= halfstep * sqrt(3)/2 /2;
-        /*
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep/2, halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-        */
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep/2, halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-
-        cairo_save(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_fill(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_stroke(cr);
-        cairo_restore(cr);
-
-        break;
-    case '@':   // sup (schwa-ish)
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        break;
-    case 'o':   // so
-        x -= halfstep /2;
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep, 0);
-        cairo_stroke(cr);
-
-        cairo_save(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_fill(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_stroke(cr);
-        cairo_restore(cr);
-
-        break;
-    case 'U':   // soot
-        x -= halfstep * sqrt(3)/2 /2;
-        y += halfstep/2 /2;
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep * sqrt(3)/2, -halfstep/2);
-        cairo_stroke(cr);
-
-        cairo_save(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_fill(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_stroke(cr);
-        cairo_restore(cr);
-
-        break;
-    case 'u':   // suit
-        x -= halfstep/2 /2;
-        y += halfstep * sqrt(3)/2 /2;
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep/2, -halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-
-        cairo_save(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_fill(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_stroke(cr);
-        cairo_restore(cr);
-
-        break;
-    default:
-        cout << "unknown vowel: " << c << endl;
-        break;
-    }
-}
+    if (! with_pages) return true;
 
-void sb_t::render_i_dipthong(char c, float x, float y) {
-    switch (c) {
-    case 'e':   // !e ei say
-        x += halfstep /2 + halfstep/2 /2;
-        y += halfstep * sqrt(3)/2 /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, -halfstep, 0);
-        cairo_rel_line_to(cr, -halfstep/2, -halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-        break;
-    case 'a':   // !a ai site
-        x += halfstep * sqrt(3)/2 /2;
-        y -= halfstep /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, 0, halfstep);
-        cairo_rel_line_to(cr, -halfstep * sqrt(3)/2, -halfstep/2);
-        cairo_stroke(cr);
-        break;
-    case 'o':   // !o oi soy
-        x -= halfstep /2;
-        y += halfstep * sqrt(3)/2 /2;
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep, 0);
-        cairo_rel_line_to(cr, -halfstep/2, -halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-
-        cairo_save(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_fill(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_stroke(cr);
-        cairo_restore(cr);
-
-        break;
-    default:
-        cout << "unknown i dipthong: " << c << endl;
-        return;
-        break;
+    if (! read_pod(in, n)) return false;
+    pages.resize(n);
+    for (recorded_page_t & page : pages) {
+        if (! read_pod(in, page.page_number)) return false;
+        if (! read_display_list(in, page.dl)) return false;
     }
-}
 
-void sb_t::render_u_dipthong(char c, float x, float y) {
-    switch (c) {
-    case 'a':   // ^a au south
-        x -= halfstep * sqrt(3)/2 /2;
-        y -= halfstep /2;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, 0, halfstep);
-        cairo_rel_line_to(cr, halfstep * sqrt(3)/2, -halfstep/2);
-        cairo_stroke(cr);
-        break;
-    case 'o':   // ^o ou low
-        x -= halfstep /2 + halfstep/2 /2;
-        y += halfstep * sqrt(3)/2 /2;
-        cairo_move_to(cr, x, y);
-        cairo_rel_line_to(cr, halfstep, 0);
-        cairo_rel_line_to(cr, halfstep/2, -halfstep * sqrt(3)/2);
-        cairo_stroke(cr);
-
-        cairo_save(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_fill(cr);
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_stroke(cr);
-        cairo_restore(cr);
-
-        break;
-    default:
-        cout << "unknown u dipthong: " << c << endl;
-        break;
-    }
+    return true;
 }
 
-bool vowel(char c) {
-    switch (c) {
-    case 'a':
-    case 'A':
-    case 'e':
-    case 'E':
-    case 'i':
-    case 'I':
-    case 'o':
-    case 'O':
-    case 'u':
-    case 'U':
-    case '!':
-    case '^':
-    case '@':
-        return true;
-        break;
-    default:
-        return false;
-        break;
-    }
-}
+void layout_cache_t::save(string filename) {
+    ofstream out(filename, ios::binary);
+    write_pod(out, CACHE_MAGIC);
+    write_pod(out, CACHE_VERSION);
+    write_pod(out, dict_hash);
 
-bool voiced(char c) {
-    switch (c) {
-    case 'b':
-    case 'v':
-    case 'D':
-    case 'd':
-    case 'z':
-    case 'Z':
-    case 'g':
-        return true;
-        break;
-    default:
-        return false;
-        break;
+    write_pod(out, (uint64_t) paras.size());
+    for (para_record_t & rec : paras) {
+        write_pod(out, rec.hash);
+        write_pod(out, rec.before);
+        write_pod(out, rec.after);
+        write_pods(out, rec.token_sizes);
     }
-}
 
-bool logogram(char c) {
-    switch (c) {
-    case '&':
-    case 'X':
-        return true;
-        break;
-    default:
-        return false;
-        break;
+    write_pod(out, (uint64_t) pages.size());
+    for (recorded_page_t & page : pages) {
+        write_pod(out, page.page_number);
+        write_display_list(out, page.dl);
     }
 }
 
-float sb_t::size_logogram_word(string w) {
-    float size = nan();
-
-    if (w == "&") size = step*2;
-    else if (w == "XXX") size = step; // red mark for unknown word
-
-    return size;
-}
+// Re-lays out book from its first paragraph that differs from the cached
+// run until the layout state matches the cached run again, redraws only the
+// pages in between, takes every other page from the cache, and leaves cache
+// describing book.  Returns 0 if nothing changed, otherwise the index of the
+// first paragraph that wasn't typeset again; first_redrawn gets the first
+// page drawn again, or 0.
+size_t relayout(vector<para_t> & book, layout_cache_t & cache,
+                int * first_redrawn=nullptr) {
+    if (first_redrawn) * first_redrawn = 0;
+
+    layout_cache_t old;
+    swap(old, cache);
+    cache.dict_hash = old.dict_hash;
+
+    size_t n_new = book.size();
+    size_t n_old = old.paras.size();
+
+    vector<uint64_t> hashes;
+    for (para_t & para : book) hashes.push_back(para_hash(para));
+
+    size_t first = 0;
+    while (first < n_new && first < n_old
+           && hashes[first] == old.paras[first].hash) first += 1;
+
+    if (first == n_new && n_new == n_old) {
+        // nothing changed
+        swap(cache, old);
+        return 0;
+    }
+
+    size_t suffix = 0;
+    while (suffix < n_new - first && suffix < n_old - first
+           && hashes[n_new-1 - suffix] == old.paras[n_old-1 - suffix].hash) {
+        suffix += 1;
+    }
+
+    // the first changed paragraph starts on first_page, or an appended one
+    // on the page the cached run ended on; every paragraph that reaches
+    // that page has to be typeset again to redraw it
+    int first_page = 1;
+    size_t start = 0;
+    if (n_old > 0) {
+        if (first < n_old) first_page = old.paras[first].before.page_number;
+        else first_page = old.paras[n_old-1].after.page_number;
+        while (old.paras[start].after.page_number < first_page) start += 1;
+    }
+
+    collect_sink_t fresh;
+    target_t tgt(RECORD_TARGET, & fresh);
+    typesetter_t ts(tgt);
+
+    if (start == 0) tgt.new_page();
+    else ts.resume(old.paras[start].before, book[start]);
+
+    cache.paras.assign(old.paras.begin(), old.paras.begin() + start);
+
+    // once resynced, finish drawing the page the cached run resumes on
+    int synced_page = 0;
+    ptrdiff_t delta = (ptrdiff_t) n_old - (ptrdiff_t) n_new;
+    size_t ix;
+    for (ix = start; ix < n_new; ix += 1) {
+        if (synced_page && tgt.page_number > synced_page) break;
+
+        para_record_t rec;
+        rec.hash = hashes[ix];
+        rec.before = ts.save_state();
+        ts.typeset(book[ix], & rec.token_sizes);
+        rec.after = ts.save_state();
+
+        if (! synced_page && ix >= first && ix+1 >= n_new - suffix) {
+            ptrdiff_t old_ix = ix + delta;
+            if (old_ix >= 0 && old_ix < (ptrdiff_t) n_old
+                && rec.after == old.paras[old_ix].after) {
+                synced_page = rec.after.page_number;
+            }
+        }
 
-void sb_t::render_logogram_word(string w) {
-    if (w == "&") {
-        cairo_new_sub_path(cr);
-        cairo_arc_negative(cr, spinex-halfstep,riby, halfstep, M_PI,2*M_PI);
-        cairo_rel_line_to(cr, 0, step);
-        cairo_rel_curve_to(cr, 0,step, -step,0, 0,0);
-        cairo_rel_curve_to(cr, halfstep,0, halfstep,step, 0,step);
-        cairo_rel_line_to(cr, -step, 0);
-        riby += step*2;
-    }
-    else if (w == "XXX") {
-        // red mark for unknown word
-        cairo_save(cr);
-        cairo_set_source_rgb(cr, 1,0,0);
-        cairo_rectangle(cr, spinex-halfstep,riby, step,step);
-        cairo_fill(cr);
-        cairo_restore(cr);
-        riby += step;
+        cache.paras.push_back(move(rec));
     }
-    else cout << "unknown logogram word: " << w << endl;
-
-    cairo_stroke(cr);
-}
-
-float sb_t::size_vowel_word(string w) {
-    float size = nan();
 
-    if (w == "A") size = halfstep;
-    else if (w == "E") size = halfstep;
-    else if (w == "I") size = step;
-    else if (w == "O") size = step;
-    else if (w == "U") size = step;
-
-    return size;
-}
+    if (synced_page && tgt.page_number > synced_page) tgt.discard_page();
+    tgt.save_and_close();
 
-void sb_t::render_vowel_word(string w) {
-    if (w == "A") {
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex,riby, halfstep, 2*M_PI,M_PI);
-        riby += halfstep;
-    }
-    else if (w == "E") {
-        cairo_arc(cr, spinex,riby, halfstep, 2*M_PI,M_PI);
-        riby += halfstep;
-        float vowely = riby - halfstep;
-        render_vowel("i", markx, vowely);
+    if (synced_page) {
+        for (size_t jx = ix + delta; jx < n_old; jx += 1) {
+            cache.paras.push_back(move(old.paras[jx]));
+        }
     }
-    else if (w == "I") {
-        riby += step;
-        cairo_move_to(cr, spinex, riby);
-        cairo_rel_curve_to(cr, step,0, step,-step, step,-step);
+
+    int last_page = synced_page ? synced_page : numeric_limits<int>::max();
+    for (recorded_page_t & page : old.pages) {
+        if (page.page_number < first_page) cache.pages.push_back(move(page));
     }
-    else if (w == "O") {
-        riby += halfstep;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex,riby, halfstep, 0,2*M_PI);
-        riby += halfstep;
+    for (recorded_page_t & page : fresh.pages) {
+        if (page.page_number >= first_page && page.page_number <= last_page) {
+            cache.pages.push_back(move(page));
+        }
     }
-    else if (w == "U") {
-        riby += halfstep;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex,riby, halfstep, 0,2*M_PI);
-        riby += halfstep;
-        float vowely = riby - halfstep;
-        render_vowel("u", markx, vowely);
+    if (synced_page) {
+        for (recorded_page_t & page : old.pages) {
+            if (page.page_number > last_page) cache.pages.push_back(move(page));
+        }
     }
-    else cout << "unknown vowel word: " << w << endl;
 
-    cairo_stroke(cr);
-}
-
-float sb_t::size_digit(char c) {
-    float size = nan();
-
-    switch (c) {
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-        size = step;
-        break;
-    case '#':
-        // ordinal ideogram
-        size = halfstep;
-        break;
-    default:
-        break;
-    }
+    cout << "redrew pages " << first_page << "-"
+         << min(last_page, cache.pages.back().page_number)
+         << " of " << cache.pages.size() << endl;
 
-    return size;
+    if (first_redrawn) * first_redrawn = first_page;
+    return ix;
 }
 
-void sb_t::render_digit(char c) {
-    switch (c) {
-    case '0':
-        cairo_move_to(cr, spinex-halfstep, riby);
-        cairo_line_to(cr, spinex+halfstep, riby);
-        cairo_line_to(cr, spinex+halfstep/2, riby+step/3);
-        cairo_curve_to(cr, spinex+halfstep,riby+step/3, spinex+halfstep,riby+step, spinex,riby+step);
-        cairo_curve_to(cr, spinex-step/3,riby+step, spinex-halfstep,riby+2*step/3, spinex-step/3,riby+halfstep);
-        riby += step;
-        break;
-    case '1':
-        cairo_move_to(cr, spinex, riby);
-        cairo_line_to(cr, spinex, riby+step);
-        riby += step;
-        break;
-    case '2':
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex+halfstep/2,riby, halfstep/2, 0,M_PI);
-        cairo_line_to(cr, spinex, riby+step);
-        riby += step;
-        break;
-    case '3':
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex+3*halfstep/2,riby, halfstep/2, 0,M_PI);
-        cairo_arc(cr, spinex+halfstep/2,riby, halfstep/2, 0,M_PI);
-        cairo_line_to(cr, spinex, riby+step);
-        riby += step;
-        break;
-    case '4':
-        cairo_move_to(cr, spinex+3*halfstep/2, riby);
-        cairo_line_to(cr, spinex+halfstep, riby+halfstep);
-        cairo_rel_curve_to(cr, 0,-3*halfstep/2, -halfstep,-3*halfstep/2, -halfstep,0);
-        cairo_line_to(cr, spinex, riby+step);
-        riby += step;
-        break;
-    case '5':
-        cairo_move_to(cr, spinex+halfstep, riby);
-        cairo_line_to(cr, spinex, riby+halfstep);
-        cairo_rel_curve_to(cr, step,0, -halfstep/2,halfstep, -halfstep/2,halfstep);
-        riby += step;
-        break;
-    case '6':
-        cairo_move_to(cr, spinex+halfstep, riby+halfstep);
-        cairo_rel_curve_to(cr, -step*2,0, 0,-step, 0,0);
-        cairo_rel_curve_to(cr, 0,halfstep, -step,halfstep, -step,halfstep);
-        cairo_line_to(cr, spinex+halfstep, riby+step);
-        riby += step;
-        break;
-    case '7':
-        cairo_move_to(cr, spinex-halfstep, riby);
-        cairo_curve_to(cr, spinex,riby+halfstep/2, spinex,riby+halfstep/2, spinex+halfstep,riby+halfstep/4);
-        cairo_curve_to(cr, spinex+step,riby, spinex+step/2,riby-step/2+halfstep/8, spinex+halfstep,riby+halfstep/4);
-        cairo_line_to(cr, spinex, riby+step);
-        cairo_line_to(cr, spinex-halfstep, riby+halfstep);
-        riby += step;
-        break;
-    case '8':
-        cairo_move_to(cr, spinex-halfstep, riby);
-        cairo_curve_to(cr, spinex-halfstep,riby+halfstep, spinex+halfstep/2,riby+halfstep, spinex+halfstep/2,riby);
-        cairo_line_to(cr, spinex-halfstep, riby+step);
-        cairo_line_to(cr, spinex+halfstep, riby+step);
-        riby += step;
-        break;
-    case '9':
-        cairo_move_to(cr, spinex, riby+halfstep);
-        cairo_curve_to(cr, spinex-step,riby+halfstep/2, spinex,riby-halfstep, spinex,riby+halfstep);
-        cairo_line_to(cr, spinex, riby+step);
-        riby += step;
-        break;
-    case '#':
-        // ordinal ideogram
-        cairo_move_to(cr, leftx, riby);
-        cairo_line_to(cr, spinex, riby);
-        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
-        riby += halfstep;
-        cairo_line_to(cr, rightx, riby);
-        break;
-    default:
-        cout << "unknown digit: " << c << endl;
-        break;
+void render_incremental(vector<para_t> & book, string filename,
+                        string cache_filename) {
+    layout_cache_t cache;
+    uint64_t dict_hash = dictionary_hash();
+    if (! cache.load(cache_filename) || cache.dict_hash != dict_hash) {
+        cache = layout_cache_t();
     }
-}
+    cache.dict_hash = dict_hash;
 
-float sb_t::size_numeral(string w) {
-    float size = 0;
+    bool changed = relayout(book, cache) != 0;
 
-    for (char c : w) {
-        if (isalpha(c)) {
-            // assume it's an ordinal
-            size += size_digit('#');
-            break;
-        }
+    unique_ptr<page_sink_t> out(open_sink(filename));
+    for (recorded_page_t & page : cache.pages) out->add_page(page);
+    out->finish();
 
-        size += size_digit(c);
-        size += wordstep/2; //TODO omit this at end of numeral?
-    }
-
-    return size;
+    if (changed) cache.save(cache_filename);
 }
 
-void sb_t::render_numeral(string w) {
-    for (char c : w) {
-        if (isalpha(c)) {
-            // assume it's an ordinal
-            render_digit('#');
-            break;
-        }
-
-        render_digit(c);
-        riby += wordstep/2;
+bool same_pages(const vector<recorded_page_t> & a,
+                const vector<recorded_page_t> & b) {
+    if (a.size() != b.size()) return false;
+    for (size_t ix = 0; ix < a.size(); ix += 1) {
+        ostringstream x, y;
+        write_display_list(x, a[ix].dl);
+        write_display_list(y, b[ix].dl);
+        if (a[ix].page_number != b[ix].page_number || x.str() != y.str()) return false;
     }
-
-    cairo_stroke(cr);
+    return true;
 }
 
-void sb_t::render_vowel(string v, float x, float y) {
-    cairo_path_t * saved_path = cairo_copy_path(cr);
-    cairo_new_path(cr);
-
-    if (v[0] == '!') render_i_dipthong(v[1], x, y);
-    else if (v[0] == '^') render_u_dipthong(v[1], x, y);
-    else render_monopthong(v[0], x, y);
-
-    cairo_new_path(cr);
-    cairo_append_path(cr, saved_path);
-    cairo_path_destroy(saved_path);
+// Lays out shorter, then book, which adds paragraphs to its end, the way
+// --incremental and --watch would, and checks that only the pages from the
+// one the first new paragraph starts on were drawn again and that the
+// result is what laying out book from scratch gives.
+bool check_append(vector<para_t> shorter, vector<para_t> & book, string what) {
+    // the word warnings and redrawn ranges would bury the result
+    streambuf * saved = cout.rdbuf(nullptr);
+    layout_cache_t cache;
+    relayout(shorter, cache);
+    int first_redrawn;
+    relayout(book, cache, & first_redrawn);
+    layout_cache_t full;
+    relayout(book, full);
+    cout.rdbuf(saved);
+    cout.clear();
+
+    int expected = full.paras[shorter.size()].before.page_number;
+    bool match = same_pages(cache.pages, full.pages);
+    bool ok = first_redrawn == expected && match;
+    cout << what << ": redrew from page " << first_redrawn << " (expected "
+         << expected << "), pages " << (match ? "match" : "differ")
+         << (ok ? "" : ", FAILED") << endl;
+    return ok;
 }
 
-vector<string> split_vowels(string text) {
-    vector<string> vs;
+// --check-relayout: the edit made most while writing is a paragraph added
+// at the end, which lands just before the key page; without the key page
+// the new paragraph follows the whole cached run
+void check_relayout(vector<para_t> & book) {
+    size_t last = book.size() - 1;   // the key page
+    if (last < 2) die("--check-relayout needs a longer book");
 
-    int ix = 0;
-    while (ix < text.length()) {
-        if (text[ix] == '!' || text[ix] == '^') {
-            vs.push_back(text.substr(ix, 2));
-            ix += 2;
-        }
-        else {
-            vs.push_back(text.substr(ix, 1));
-            ix += 1;
-        }
-    }
+    vector<para_t> shorter(book);
+    shorter.erase(shorter.begin() + last - 1);
+    bool ok = check_append(shorter, book, "paragraph added before the key page");
 
-    return vs;
-}
+    vector<para_t> text(book.begin(), book.begin() + last);
+    shorter.assign(text.begin(), text.end() - 1);
+    ok = check_append(shorter, text, "paragraph added after the last one") && ok;
 
-float sb_t::size_punct(string w) {
-    float size = nan();
-
-    if (w == "-") size = 0;
-    else if (w == "--" || w == ";" || w == ":") size = step;
-    else if (w == "----") size = wordstep*2;
-    else if (w == ",") size = 0;
-    else if (w == ".") size = halfstep;
-    else if (w == "!") size = 0;
-    else if (w == "?") size = 0;
-    else if (w == "\"") size = ribstep;
-    else if (w == "(") size = 0;
-    else if (w == ")") size = 0;
-    else if (w == "/") size = 0;   //TODO move this into word object
-
-    return size;
+    if (! ok) exit(1);
 }
 
-void sb_t::render_punct(string w) {
-    cairo_path_t * saved_path = cairo_copy_path(cr);
-    cairo_new_path(cr);
-
-    if (w == "-") {
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
-        cairo_fill(cr);
-    }
-    else if (w == "--" || w == ";" || w == ":") {
-        cairo_move_to(cr, spinex-step-halfstep, riby);
-        cairo_line_to(cr, spinex-halfstep-halfstep, riby+halfstep);
-        cairo_line_to(cr, spinex-step-halfstep, riby+step);
-        cairo_move_to(cr, spinex-halfstep-halfstep, riby+halfstep);
-        cairo_line_to(cr, spinex-halfstep, riby+halfstep);
-        cairo_stroke(cr);
-        riby += step;
-    }
-    else if (w == "----") {
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
-        riby += wordstep;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
-        riby += wordstep;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
-        /*
-        riby += wordstep;
-        cairo_new_sub_path(cr);
-        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
-        */
-        cairo_fill(cr);
-    }
-    else if (w == ",") {
-        cairo_move_to(cr, spinex-step-halfstep, riby-halfstep);
-        cairo_line_to(cr, spinex-halfstep-halfstep, riby);
-        cairo_line_to(cr, spinex-step-halfstep, riby+halfstep);
-        cairo_stroke(cr);
-    }
-    else if (w == ".") {
-        cairo_move_to(cr, spinex-step-halfstep, riby-halfstep);
-        cairo_line_to(cr, spinex-step-halfstep, riby);
-        cairo_line_to(cr, spinex, riby);
-        cairo_stroke(cr);
-        riby += halfstep;
-    }
-    else if (w == "!") {
-        cairo_move_to(cr, spinex-step-halfstep/2, riby-step);
-        cairo_rel_curve_to(cr, -step,halfstep, halfstep,halfstep, -halfstep,step);
-        cairo_line_to(cr, spinex, riby);
-        cairo_stroke(cr);
-    }
-    else if (w == "?") {
-        cairo_move_to(cr, spinex-step-halfstep, riby-halfstep);
-        cairo_rel_curve_to(cr, 0,-halfstep, step,-halfstep, 0,halfstep);
-        cairo_line_to(cr, spinex, riby);
-        cairo_stroke(cr);
-    }
-    else if (w == "\"") {
-        cairo_move_to(cr, spinex-step-halfstep, riby);
-        cairo_line_to(cr, spinex-step, riby);
-        riby += ribstep;
-        cairo_move_to(cr, spinex-step-halfstep, riby);
-        cairo_line_to(cr, spinex-step, riby);
-        cairo_stroke(cr);
-    }
-    else if (w == "(") {
-        cairo_move_to(cr, spinex, riby);
-        cairo_rel_curve_to(cr, -step,0, -step-halfstep,halfstep, -step-halfstep,step);
-        cairo_stroke(cr);
-    }
-    else if (w == ")") {
-        cairo_move_to(cr, spinex, riby);
-        cairo_rel_curve_to(cr, -step,0, -step-halfstep,-halfstep, -step-halfstep,-step);
-        cairo_stroke(cr);
+// The layout state around every paragraph of book, taken from the
+// incremental cache when it is current and from a measuring pass otherwise.
+vector<para_record_t> layout_index(vector<para_t> & book,
+                                   string cache_filename) {
+    layout_cache_t cache;
+    if (cache.load(cache_filename, false) && cache.dict_hash == dictionary_hash()
+        && cache.paras.size() == book.size()) {
+        bool current = true;
+        for (size_t ix = 0; ix < book.size(); ix += 1) {
+            if (cache.paras[ix].hash != para_hash(book[ix])) current = false;
+        }
+        if (current) return cache.paras;
     }
-    else cout << "unknown punct: " << w << endl;
 
-    cairo_new_path(cr);
-    cairo_append_path(cr, saved_path);
-    cairo_path_destroy(saved_path);
-}
+    vector<para_record_t> index;
 
-bool isprosody(char c) {
-    switch (c) {
-    case '/':
-    case '-':
-    case ',':
-    case '.':
-    case '!':
-    case '?':
-    case '(':
-    case ')':
-    case '"':
-    case ';':
-    case ':':
-        return true;
-        break;
-    default:
-        return false;
-        break;
+    target_t tgt(MEASURE_TARGET);
+    tgt.new_page();
+    typesetter_t ts(tgt);
+    for (para_t & para : book) {
+        para_record_t rec;
+        rec.hash = para_hash(para);
+        rec.before = ts.save_state();
+        ts.typeset(para);
+        rec.after = ts.save_state();
+        index.push_back(rec);
     }
-}
 
-void sbj_t::render_column_divider() {
-    next_column();
-
-    float col_top = target.margin + inner_row_height * (cur_row-1);
-    float col_bot = col_top + column_height;
-
-    float frac = column_height / 3;
+    return index;
+}
 
-    cairo_move_to(scr, spinex, col_top+frac);
-    cairo_line_to(scr, spinex, col_bot-frac);
-    cairo_stroke(scr);
+// pages spanned by a chapter, with chapter 0 for the front matter
+bool chapter_pages(vector<para_t> & book, vector<para_record_t> & index,
+                   int chapter, int & first_page, int & last_page) {
+    int heading = 0;
+    first_page = 1;
+    for (size_t ix = 0; ix < book.size(); ix += 1) {
+        if (book[ix].kind != HEADING_PARA && book[ix].kind != KEY_PAGE) continue;
+
+        if (heading == chapter) {
+            last_page = index[ix].before.page_number;
+            return true;
+        }
 
-    need_fresh_column = true;
+        heading += 1;
+        first_page = index[ix].before.page_number + 1;
+    }
+    return false;
 }
 
-float sb_t::size_phonetic_word(string w) {
-    float temp_riby = starty;
-
-    if (logogram(w[0])) {
-        return size_logogram_word(w);
+// Draws only pages first_page to last_page, starting layout from the
+// paragraph that reaches first_page rather than from the start of the book.
+void render_pages(vector<para_t> & book, vector<para_record_t> & index,
+                  int first_page, int last_page, string filename) {
+    int npages = index.empty() ? 0 : index.back().after.page_number;
+    if (first_page > npages) {
+        die("bad page range: the book has " + to_string(npages) + " pages");
     }
 
-    // this must come before vowel() because '!' is a "vowel"
-    if (isprosody(w[0])) {
-        return size_punct(w);
+    size_t start = 0;
+    while (start < index.size() && index[start].after.page_number < first_page) {
+        start += 1;
     }
 
-    if (vowel(w[0])) {
-        return size_vowel_word(w);
+    target_t tgt(filename);
+    tgt.first_drawn = first_page;
+    tgt.last_drawn = last_page;
+    {
+        typesetter_t ts(tgt);
+        if (start == 0) tgt.new_page();
+        else ts.resume(index[start].before, book[start]);
+
+        for (size_t ix = start; ix < book.size(); ix += 1) {
+            if (tgt.page_number > last_page) break;
+            ts.typeset(book[ix]);
+        }
     }
+    tgt.save_and_close();
+}
 
-    if (isdigit(w[0])) {
-        return size_numeral(w);
+// Splits the book into nvolumes page ranges, preferring to break at
+// chapters, and renders each in its own process running this program on
+// one range.  The volumes are written with the native pdf writer, whose
+// files can be merged without a general pdf parser.
+void render_volumes(vector<para_t> & book, string input, string filename,
+                    int nvolumes, string self, string cache_filename) {
+    vector<para_record_t> index = layout_index(book, cache_filename);
+    if (index.empty()) die("nothing to split into volumes");
+    int npages = index.back().after.page_number;
+
+    vector<int> chapter_starts;
+    for (size_t ix = 0; ix < book.size(); ix += 1) {
+        if (book[ix].kind == HEADING_PARA || book[ix].kind == KEY_PAGE) {
+            chapter_starts.push_back(index[ix].before.page_number + 1);
+        }
     }
 
-    if (w[0] != '`') temp_riby += ribstep/2;
-
-    int ix = 0;
-    int lastrib_ix;
-    while (ix < w.length()) {
-        int nextrib_ix = ix + 1;
-        while (nextrib_ix<w.length() && vowel(w[nextrib_ix])) nextrib_ix += 1;
-
-        float prerib_riby = temp_riby;
-        if (w[ix] == '`') temp_riby += size_vowel_hook();
-        else temp_riby += size_consonant(w[ix]);
-        float rib_height = temp_riby - prerib_riby;
-
-        float pregap_riby = temp_riby;
-
-        // do current and next ribs need a gap?
-        fills_t fills = consonant_fills(w[ix]);
-        if (nextrib_ix<w.length()) {
-            fills_t fills2 = consonant_fills(w[nextrib_ix]);
-            if (fills.l_bot && fills2.l_top
-             || fills.c_bot && fills2.c_top
-             || fills.r_bot && fills2.r_top
-             ) {
-                // gap
-                temp_riby += ribstep;
-            }
-            else {
-                // no gap
-                //XXX experiment with small gap due to eg "disquiet"
-                temp_riby += ribstep/3;
+    // the nearest chapter start within half a volume's share of the even
+    // split wins, the earlier of two as near
+    vector<int> firsts = {1};
+    for (int vol = 1; vol < nvolumes; vol += 1) {
+        int ideal = 1 + vol * npages / nvolumes;
+        int first = ideal;
+        int best = -1;   // distance from ideal to first, -1 until a chapter is found
+        for (int start : chapter_starts) {
+            int distance = abs(start - ideal);
+            if (distance * 2 * nvolumes > npages) continue;
+            if (best < 0 || distance < best) {
+                first = start;
+                best = distance;
             }
         }
-        else {
-            // no next rib
-            lastrib_ix = ix;
+        if (first > firsts.back() && first <= npages) firsts.push_back(first);
+    }
+    firsts.push_back(npages + 1);
+
+    // the children read the layout instead of measuring the book again
+    string index_filename = filename + ".index";
+    layout_cache_t shared;
+    shared.dict_hash = dictionary_hash();
+    shared.paras = index;
+    shared.save(index_filename);
+
+    size_t nvols = firsts.size() - 1;
+    vector<string> volumes;
+    vector<int> statuses(nvols);
+    vector<thread> children;
+    for (size_t vol = 0; vol < nvols; vol += 1) {
+        volumes.push_back(filename + ".vol" + to_string(vol + 1) + ".pdf");
+        string command = "\"" + self + "\" --native-pdf --pages="
+            + to_string(firsts[vol]) + "-" + to_string(firsts[vol+1] - 1)
+            + " --index=\"" + index_filename + "\" --output=\"" + volumes[vol]
+            + "\" \"" + input + "\"";
+        children.push_back(thread([&statuses, vol, command] {
+            statuses[vol] = system(command.c_str());
+        }));
+    }
+    for (thread & child : children) child.join();
+    remove(index_filename.c_str());
+
+    for (size_t vol = 0; vol < nvols; vol += 1) {
+        if (statuses[vol] != 0) die("volume " + to_string(vol + 1) + " failed");
+    }
+
+    pdf_writer_t out(filename);
+    for (size_t vol = 0; vol < nvols; vol += 1) {
+        if (! out.append_pdf(volumes[vol], firsts[vol])) {
+            die("can't merge " + volumes[vol]);
         }
+        remove(volumes[vol].c_str());
+    }
+    out.finish();
 
-        // size vowel if any
-        float vowely_center;
-        if (nextrib_ix < w.length() && vowel(w[ix+1])) {
-            // there's a vowel then a following rib
-            string vtext = w.substr(ix + 1, nextrib_ix - ix - 1);
-            vector<string> vs = split_vowels(vtext);
-
-            if (w[ix] == '`') vowely_center = pregap_riby - halfstep/2;
-            else if (w[nextrib_ix] == '`') vowely_center = temp_riby + halfstep/2;
-            else {
-                // next rib is a consonant
-                float prevy, nexty;
-
-                // this only works because voiced ribs never have vowel space
-                if (voiced(w[ix])) {
-                    prevy = pregap_riby - rib_height/2 + voicedlen/2;
-                }
-                else prevy = pregap_riby - vowel_space(w[ix]).after;
+    cout << nvols << " volumes, " << npages << " pages" << endl;
+}
 
-                if (voiced(w[nextrib_ix])) {
-                    //TODO assume 0 because we don't know height of next rib
-                    nexty = temp_riby + 0/2 - voicedlen/2;
-                }
-                else nexty = temp_riby + vowel_space(w[nextrib_ix]).before;
-
-                float vowel_room = nexty - prevy;
-                float vowel_needs = vowel_size * vs.size();
-                if (vowel_room < vowel_needs) {
-                    float skootch = vowel_needs - vowel_room;
-                    temp_riby += skootch;
-                    nexty += skootch;
-                }
+// Renders every book named in a manifest of "<input> <output>" lines on a
+// pool of njobs threads, sharing the dictionary loaded once by main().
+void render_batch(string manifest, int njobs) {
+    ifstream in(manifest);
+    if (! in) die("can't read " + manifest);
 
-                vowely_center = (prevy + nexty) / 2;
-            }
+    vector<pair<string, string>> jobs;
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string input, output;
+        if (! (fields >> input)) continue;
+        if (input[0] == '#') continue;
+        if (! (fields >> output)) die("no output file for " + input);
+        jobs.push_back({input, output});
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    atomic<int> pages(0);
+    atomic<int> failed(0);
+    for_each_parallel(njobs, jobs.size(), [&](size_t ix) {
+        if (! ifstream(jobs[ix].first)) {
+            cout << "can't read " << jobs[ix].first << endl;
+            failed += 1;
+            return;
         }
+        pages += render_serial(jobs[ix].first, jobs[ix].second);
+    });
+
+    double seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    int books = jobs.size() - failed;
+    cout << books << " books, " << pages << " pages in " << fixed
+         << setprecision(1) << seconds << " s, " << books * 60 / seconds
+         << " books/min" << endl;
+    if (failed) die(to_string(failed) + " books failed");
+}
 
-        ix = nextrib_ix;
+// whether para has a word whose pronunciation is in words
+bool para_uses(const para_t & para, const set<string> & words) {
+    if (para.kind == DIVIDER_PARA || para.kind == KEY_PAGE) return false;
+    word_list_t ws = split_words(para.text);
+    for (size_t ix = 0; ix < ws.size(); ix += 1) {
+        if (words.count(pronunciation_key(ws[ix]))) return true;
     }
-
-    if (w[lastrib_ix] == '`') temp_riby -= halfstep;
-    else temp_riby += ribstep/2;
-
-    if (w[lastrib_ix] == '`') temp_riby += halfstep;
-
-    return temp_riby - starty;
+    return false;
 }
 
-void sb_t::render_phonetic_word(string w) {
-    riby = starty;
-
-    if (logogram(w[0])) {
-        render_logogram_word(w);
-        return;
+// Re-renders after a dictionary change, laying out again from each
+// paragraph with a changed word until the layout resyncs.
+void relayout_words(vector<para_t> & book, layout_cache_t & cache,
+                    const map<string, string> & old_pronunciation) {
+    set<string> changed;
+    for (auto & entry : pronunciation) {
+        auto found = old_pronunciation.find(entry.first);
+        if (found == old_pronunciation.end() || found->second != entry.second) {
+            changed.insert(entry.first);
+        }
     }
-
-    // this must come before vowel() because '!' is a "vowel"
-    if (isprosody(w[0])) {
-        render_punct(w);
-        return;
+    for (auto & entry : old_pronunciation) {
+        if (! pronunciation.count(entry.first)) changed.insert(entry.first);
     }
 
-    if (vowel(w[0])) {
-        render_vowel_word(w);
+    cache.dict_hash = dictionary_hash();
+    if (cache.paras.size() != book.size()) {
+        relayout(book, cache);
         return;
     }
 
-    if (isdigit(w[0])) {
-        render_numeral(w);
-        return;
+    // a paragraph that doesn't match its cached hash is laid out again
+    size_t done = 0;
+    for (size_t ix = 0; ix < book.size(); ix += 1) {
+        if (ix < done || ! para_uses(book[ix], changed)) continue;
+        cache.paras[ix].hash = ~ cache.paras[ix].hash;
+        done = relayout(book, cache);
     }
-
-    if (w[0] != '`') riby += ribstep/2;
-
-    int ix = 0;
-    int lastrib_ix;
-    while (ix < w.length()) {
-        int nextrib_ix = ix + 1;
-        while (nextrib_ix<w.length() && vowel(w[nextrib_ix])) nextrib_ix += 1;
-
-        float prerib_riby = riby;
-        if (w[ix] == '`') render_vowel_hook();
-        else render_consonant(w[ix]);
-        float rib_height = riby - prerib_riby;
-
-        float pregap_riby = riby;
-
-        // do current and next ribs need a gap?
-        fills_t fills = consonant_fills(w[ix]);
-        if (nextrib_ix<w.length()) {
-            fills_t fills2 = consonant_fills(w[nextrib_ix]);
-            if (fills.l_bot && fills2.l_top
-             || fills.c_bot && fills2.c_top
-             || fills.r_bot && fills2.r_top
-             ) {
-                // gap
-                riby += ribstep;
-            }
-            else {
-                // no gap
-                //XXX experiment with small gap due to eg "disquiet"
-                riby += ribstep/3;
-            }
-        }
-        else {
-            // no next rib
-            lastrib_ix = ix;
-        }
-
-        // render vowel if any
-        float vowely_center;
-        if (nextrib_ix < w.length() && vowel(w[ix+1])) {
-            // there's a vowel then a following rib
-            string vtext = w.substr(ix + 1, nextrib_ix - ix - 1);
-            vector<string> vs = split_vowels(vtext);
-
-            if (w[ix] == '`') vowely_center = pregap_riby - halfstep/2;
-            else if (w[nextrib_ix] == '`') vowely_center = riby + halfstep/2;
-            else {
-                // next rib is a consonant
-                float prevy, nexty;
-
-                // this only works because voiced ribs never have vowel space
-                if (voiced(w[ix])) {
-                    prevy = pregap_riby - rib_height/2 + voicedlen/2;
-                }
-                else prevy = pregap_riby - vowel_space(w[ix]).after;
-
-                if (voiced(w[nextrib_ix])) {
-                    //TODO assume 0 because we don't know height of next rib
-                    nexty = riby + 0/2 - voicedlen/2;
-                }
-                else nexty = riby + vowel_space(w[nextrib_ix]).before;
-
-                float vowel_room = nexty - prevy;
-                float vowel_needs = vowel_size * vs.size();
-                if (vowel_room < vowel_needs) {
-                    float skootch = vowel_needs - vowel_room;
-                    riby += skootch;
-                    nexty += skootch;
-                }
-
-                vowely_center = (prevy + nexty) / 2;
-            }
-
-            float vowely = vowely_center - vowel_size * (vs.size()-1) / 2.0;
-            for (string v : vs) {
-                render_vowel(v, markx, vowely);
-                vowely += vowel_size;
-            }
-        }
-
-        ix = nextrib_ix;
-    }
-
-    if (w[lastrib_ix] == '`') riby -= halfstep;
-    else riby += ribstep/2;
-
-    cairo_move_to(cr, spinex, starty);
-    cairo_line_to(cr, spinex, riby);
-
-    if (w[lastrib_ix] == '`') riby += halfstep;
-
-    if (emphasis) {
-        cairo_move_to(cr, spinex-step-halfstep, starty);
-        cairo_line_to(cr, spinex-step-halfstep, riby);
-    }
-
-    cairo_stroke(cr);
 }
 
-void sb_t::render_phonetic_words(vector<string> & ws) {
-    for (auto w : ws) {
-        if (w == "/") {
-            emphasis = ! emphasis;
-            continue;
-        }
-
-        render_phonetic_word(w);
-        starty = riby + wordstep;
+void write_cached_pages(layout_cache_t & cache, string filename) {
+    unique_ptr<page_sink_t> out(open_sink(filename));
+    for (recorded_page_t & page : cache.pages) {
+        recorded_page_t copy = page;
+        out->add_page(copy);
     }
+    out->finish();
 }
 
-map<string, string> pronunciation;
-
-string phoneticize_word(string raw_w) {
-    if (isdigit(raw_w[0])) return raw_w;
-    if (isprosody(raw_w[0])) return raw_w;
-    if (raw_w[0] == '\'') raw_w = raw_w.substr(1);
-
-    string w;
-    for (char c : raw_w) w.push_back(tolower(c));
-    if (w.empty()) return "";
+#ifndef _WIN32
+// --watch and --serve run until interrupted; SIGINT and SIGTERM make them
+// return instead, so the atexit reports (--stats, --trace) still get written
+volatile sig_atomic_t stop_requested = 0;
 
-    if (pronunciation.count(w)) return pronunciation[w];
-
-    cout << "unknown word: " << raw_w << endl;
-    return "XXX"; // red mark for unknown word
+void request_stop(int) {
+    stop_requested = 1;
 }
 
-vector<string> phoneticize_words(vector<string> ws) {
-    vector<string> ps;
-    for (auto w : ws) {
-        string p = phoneticize_word(w);
-        if (p.length() != 0) ps.push_back(p);
-    }
-    return ps;
+void stop_on_interrupt() {
+    struct sigaction action = {};
+    action.sa_handler = request_stop;   // no SA_RESTART: poll and accept return EINTR
+    sigaction(SIGINT, & action, nullptr);
+    sigaction(SIGTERM, & action, nullptr);
 }
-
-set<string> abbrevs = {"Mrs", "Mr", "St", "EDW", "E", "M"};
-
-vector<string> split_words(string text) {
-    vector<string> ws;
-    string w;
-
-    for (char c : text) {
-        if (isspace(c)) {
-            if (! w.empty()) {
-                ws.push_back(w);
-                w.clear();
-            }
-        }
-        else if (isdigit(c)) {
-            if (w.empty() || isdigit(w.back())) w.push_back(c);
-            else {
-                ws.push_back(w);
-                w.clear();
-                w.push_back(c);
-            }
-        }
-        else if (isalpha(c) || c == '\'') {
-            if (w.empty() || isalpha(w.back()) || w.back() == '\'') {
-                w.push_back(c);
-            }
-            else if (isdigit(w.back())) w.push_back(c);
-            else {
-                ws.push_back(w);
-                w.clear();
-                w.push_back(c);
-            }
-        }
-        else if (c == '-') {
-            if (w.empty() || w.back() == '-') w.push_back(c);
-            else {
-                ws.push_back(w);
-                w.clear();
-                w.push_back(c);
+#endif
+
+// Renders the book, then stays resident, re-rendering from the layout held
+// in memory whenever the book, pronunciation.txt or extras.txt is saved.
+void watch(vector<para_t> & book, string filename, string output,
+           string cache_filename) {
+#ifndef __linux__
+    die("--watch needs inotify");
+#else
+    fast_pdf = true;
+    load_extras();
+
+    layout_cache_t cache;
+    if (! cache.load(cache_filename) || cache.dict_hash != dictionary_hash()) {
+        cache = layout_cache_t();
+    }
+    cache.dict_hash = dictionary_hash();
+
+    relayout(book, cache);
+    write_cached_pages(cache, output);
+
+    // editors often save by replacing the file, so watch the directories
+    size_t slash = filename.rfind('/');
+    string dir = slash == string::npos ? "." : filename.substr(0, slash);
+    string name = slash == string::npos ? filename : filename.substr(slash + 1);
+
+    int fd = inotify_init();
+    if (fd < 0) die("can't start inotify");
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+    int book_dir = inotify_add_watch(fd, dir.c_str(), mask);
+    int dict_dir = inotify_add_watch(fd, ".", mask);
+    if (book_dir < 0 || dict_dir < 0) die("can't watch " + dir);
+
+    stop_on_interrupt();
+    cout << "watching " << filename << endl;
+    while (! stop_requested) {
+        bool book_changed = false;
+        bool dict_changed = false;
+
+        // take every event of one save together
+        char buffer[4096];
+        int timeout = -1;
+        pollfd pfd = {fd, POLLIN, 0};
+        while (! stop_requested && poll(& pfd, 1, timeout) > 0) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            for (char * p = buffer; p < buffer + n; ) {
+                inotify_event * event = (inotify_event *) p;
+                string changed = event->len ? event->name : "";
+                if (event->wd == book_dir && changed == name) book_changed = true;
+                if (event->wd == dict_dir && (changed == "pronunciation.txt"
+                                              || changed == "extras.txt")) {
+                    dict_changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
             }
+            timeout = 50;
         }
-        else if (c == '.') {
-            if (w.empty()) ws.push_back(string(1, c));
-            else if (abbrevs.count(w) == 0) {
-                ws.push_back(w);
-                w.clear();
-                ws.push_back(string(1, c));
+        if (stop_requested || (! book_changed && ! dict_changed)) continue;
+
+        auto start = chrono::steady_clock::now();
+
+        if (dict_changed) {
+            map<string, string> old_pronunciation;
+            swap(old_pronunciation, pronunciation);
+            load_phonetic();
+            load_extras();
+            if (book_changed) {
+                cache.dict_hash = dictionary_hash();
+                cache.paras.clear();
             }
+            else relayout_words(book, cache, old_pronunciation);
         }
-        else switch (c) {
-        case '"':
-        case ',':
-        case ';':
-        case ':':
-        case '!':
-        case '?':
-        case '(':
-        case ')':
-            if (! w.empty()) {
-                ws.push_back(w);
-                w.clear();
-            }
-            ws.push_back(string(1, c));
-            break;
-        case '_':
-            if (! w.empty()) {
-                ws.push_back(w);
-                w.clear();
-            }
-            ws.push_back(string(1, '/'));
-            break;
-        default:
-            cout << "can't handle character: " << c << endl;
-            break;
+        if (book_changed) {
+            book = load_book(filename);
+            relayout(book, cache);
         }
-    }
-    if (! w.empty()) ws.push_back(w);
-
-    return ws;
-}
-
-void sb_t::render_at_inches(string text, float x, float y) {
-    vector<string> ws = split_words(text);
-    vector<string> ps = phoneticize_words(ws);
-
-    spinex = x;
-    leftx = spinex - step;
-    rightx = spinex + step;
-    markx = rightx + halfstep;
+        write_cached_pages(cache, output);
 
-    starty = y;
-    riby = starty;
-
-    render_phonetic_words(ps);
+        cout << "rebuilt " << output << " in " << fixed << setprecision(0)
+             << chrono::duration<double, milli>(
+                    chrono::steady_clock::now() - start).count()
+             << " ms" << endl;
+    }
+    close(fd);
+#endif
 }
 
-void sbj_t::render_columns(string text) {
-    vector<string> ws = split_words(text);
-    vector<string> ps = phoneticize_words(ws);
-
-    vector<string> col;
-    float col_size = 0;
-    for (string p : ps) {
-        if (need_fresh_column) next_column();
+// how a snippet sent to the server is drawn
+struct snippet_options_t {
+    output_format_t format = NATIVE_PDF_OUTPUT;
+    float scale = 1.0;
+    float width = 5.5;    // in inches
+    float height = 8.5;
+    float margin = 1.0;
+    float dpi = 100;
+};
 
-        float word_size = size_phonetic_word(p);
-        if (col_size + word_size <= column_height) {
-            col.push_back(p);
-            col_size += word_size + wordstep;
-        }
+// false, with the reason in error, for an option line it doesn't know
+bool parse_snippet_option(string line, snippet_options_t & options,
+                          string & error) {
+    size_t eq = line.find('=');
+    string key = line.substr(0, eq);
+    string value = eq == string::npos ? "" : line.substr(eq + 1);
+    float number = atof(value.c_str());
+
+    if (key == "format") {
+        if (value == "pdf") options.format = CAIRO_PDF_OUTPUT;
+        else if (value == "native-pdf") options.format = NATIVE_PDF_OUTPUT;
+        else if (value == "svg") options.format = SVG_OUTPUT;
+        else if (value == "png") options.format = PNG_OUTPUT;
         else {
-            render_phonetic_words(col);
-            col.clear();
-            col_size = 0;
-
-            col.push_back(p);
-            col_size += word_size + wordstep;
-
-            need_fresh_column = true;
+            error = "unknown format: " + value;
+            return false;
         }
+        return true;
     }
 
-    if (! col.empty()) {
-        render_phonetic_words(col);
-        need_fresh_column = true;
+    float * field = nullptr;
+    if (key == "scale") field = & options.scale;
+    else if (key == "width") field = & options.width;
+    else if (key == "height") field = & options.height;
+    else if (key == "margin") field = & options.margin;
+    else if (key == "dpi") field = & options.dpi;
+    else {
+        error = "unknown option: " + key;
+        return false;
     }
+    if (number <= 0 && ! (key == "margin" && number == 0)) {
+        error = "bad " + key + ": " + value;
+        return false;
+    }
+    * field = number;
+    return true;
 }
 
-//TODO change this from struct to bare functions
-struct keypage_context_t : skullbat_context_t {
-    const float FONT_SIZE = 12.0;
+// The snippet's text set in columns on pages of the requested size, with
+// no page numbers, into bytes.  Only the first page is drawn for svg and
+// png, and it is rasterized on this thread rather than by a pool.
+bool render_snippet(string text, const snippet_options_t & options,
+                    string & bytes) {
+    bool first_only = options.format == SVG_OUTPUT
+        || options.format == PNG_OUTPUT;
+
+    collect_sink_t pages;
+    {
+        target_t tgt(RECORD_TARGET, & pages, options.width, options.height,
+                     options.margin);
+        tgt.number_pages = false;
+        tgt.mark_glyphs = options.format == SVG_OUTPUT;
+        if (first_only) tgt.last_drawn = 1;
+        tgt.new_page();
+        {
+            sbj_t ctx(tgt, options.scale);
+            ctx.render_columns(text);
+        }
+        tgt.save_and_close();
+    }
+    if (pages.pages.empty()) return false;
+
+    bytes.clear();
+    if (options.format == NATIVE_PDF_OUTPUT) {
+        pdf_writer_t writer(& bytes, options.width, options.height);
+        for (recorded_page_t & page : pages.pages) writer.add_page(page);
+        writer.finish();
+    } else if (options.format == CAIRO_PDF_OUTPUT) {
+        pdf_sink_t sink(& bytes, options.width, options.height);
+        for (recorded_page_t & page : pages.pages) sink.add_page(page);
+        sink.finish();
+    } else if (options.format == SVG_OUTPUT) {
+        svg_writer_t writer("", false, options.width, options.height);
+        writer.build_page(pages.pages[0]);
+        swap(bytes, writer.page);
+    } else {
+        png_writer_t writer("", options.dpi, true, false, 0, options.width,
+                            options.height);
+        cairo_surface_t * image = writer.rasterize(pages.pages[0], options.dpi);
+        cairo_status_t status = cairo_surface_write_to_png_stream(
+            image, append_to_string, & bytes);
+        cairo_surface_destroy(image);
+        if (status != CAIRO_STATUS_SUCCESS) return false;
+    }
+    return ! bytes.empty();
+}
 
-    void draw_skull_bat(float width, float x, float y);
-    void render_latin(string text, float x, float y);
-    void render_skullbat(string text, float x, float y);
-    void render_key_page();
+const size_t MAX_SERVED_REPLIES = 1000;
+const int SERVE_TIMEOUT_SECONDS = 2;
+
+// A request is option lines such as "format=svg" or "scale=2", a blank
+// line, then the text up to the end of the stream.  The reply is
+// "ok <length>\n" followed by the file, or "error <message>\n".  Replies
+// are kept, so repeated titles and headers aren't drawn again.
+string serve_request(const string & request, map<string, string> & replies) {
+    auto found = replies.find(request);
+    if (found != replies.end()) return found->second;
+
+    size_t blank = request.find("\n\n");
+    if (blank == string::npos) return "error no blank line after the options\n";
+
+    snippet_options_t options;
+    istringstream header(request.substr(0, blank));
+    string line, error;
+    while (getline(header, line)) {
+        if (line.empty()) continue;
+        if (! parse_snippet_option(line, options, error)) {
+            return "error " + error + "\n";
+        }
+    }
 
-    keypage_context_t(target_t & newtgt, float newscale=1.0)
-            : skullbat_context_t(newtgt, newscale) {
+    string bytes;
+    if (! render_snippet(request.substr(blank + 2), options, bytes)) {
+        return "error can't render\n";
     }
-};
 
-using kp_t = keypage_context_t;
-
-void kp_t::draw_skull_bat(float width, float x, float y) {
-    cairo_surface_t * skullbat =
-        cairo_image_surface_create_from_png("skullbat.png");
-    cairo_save(cr);
-    int w = cairo_image_surface_get_width(skullbat);
-    cairo_translate(cr, x, y);
-    cairo_scale(cr, width /w, width /w);
-    cairo_set_source_surface(cr, skullbat, 0,0);
-    cairo_paint(cr);
-    cairo_restore(cr);
-    cairo_surface_destroy(skullbat);
+    string reply = "ok " + to_string(bytes.size()) + "\n" + bytes;
+    if (replies.size() >= MAX_SERVED_REPLIES) replies.clear();
+    replies[request] = reply;
+    return reply;
 }
 
-void kp_t::render_latin(string text, float x, float y) {
-    cairo_move_to(cr, x, y);
-    cairo_show_text(cr, text.c_str());
-
-    cairo_set_source_rgb(cr, 0,0,0);
-    cairo_fill(cr);
+// Renders snippets sent to a unix socket at socket_path, one connection at
+// a time, with the dictionary loaded once for all of them.  Requests and
+// replies are kept in memory; the page files are never written.
+void serve(string socket_path) {
+#ifdef _WIN32
+    die("--serve needs unix sockets");
+#else
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) die("can't create socket");
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) die("socket path too long");
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    unlink(socket_path.c_str());
+    if (bind(listener, (sockaddr *) & addr, sizeof(addr)) < 0
+        || listen(listener, 16) < 0) {
+        die("can't listen on " + socket_path);
+    }
+    cout << "listening on " << socket_path << endl;
+
+    // a client that hangs up early mustn't take the server down
+    signal(SIGPIPE, SIG_IGN);
+    stop_on_interrupt();
+
+    map<string, string> replies;
+    while (! stop_requested) {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) continue;
+
+        // a client that stalls holds up the others only this long
+        timeval timeout = {SERVE_TIMEOUT_SECONDS, 0};
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, & timeout, sizeof(timeout));
+        setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, & timeout, sizeof(timeout));
+
+        string request;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(conn, buffer, sizeof(buffer))) > 0) request.append(buffer, n);
+
+        string reply = n < 0 ? "error timed out reading the request\n"
+            : serve_request(request, replies);
+        for (size_t sent = 0; sent < reply.size(); ) {
+            n = write(conn, reply.data() + sent, reply.size() - sent);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(conn);
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+#endif
 }
 
-void kp_t::render_skullbat(string text, float x, float y) {
-    spinex = x;
-    leftx = spinex - step;
-    rightx = spinex + step;
-    markx = rightx + halfstep;
-
-    starty = y;
-    riby = starty;
-
-    render_phonetic_word(text);
+// on stderr, so the report stays apart from the word warnings
+void print_stats() {
+    write_stats_json(cerr);
 }
 
-void kp_t::render_key_page() {
-    draw_skull_bat(1, target.paper_width/2-0.5, target.margin - 3.0/4.0 /2);
-
-    set_skullbat_scale(1.5);
-
-    cairo_select_font_face(cr, "DejaVu Serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-    cairo_set_font_size(cr, FONT_SIZE/POINTS_PER_INCH);
-
-    cairo_font_extents_t fe;
-    cairo_text_extents_t te;
-    cairo_font_extents(cr, & fe);
-
-    int x = 0;
-    int y = 0;
-
-    render_latin("Skullbat Key", target.margin, target.margin+fe.height+ y *1.5*fe.height);
-
-    cairo_select_font_face(cr, "DejaVu Serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-    cairo_font_extents(cr, & fe);
-    cairo_text_extents(cr, "W", & te);
-
-    y += 1;
-    render_latin("Consonants", target.margin, target.margin+fe.height + y *1.5*fe.height);
-    y += 1;
-    render_latin("(voicing mark is optional if unambiguous)", target.margin, target.margin+fe.height + y *1.5*fe.height);
-
-    const float SKT = 1.6667;
-
-    y += 1;
-    x = 0;
-    for (string s : {"P","B","M","F","V","W"}) {
-        render_latin(s, target.margin+x*0.6, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"p","b","m","f","v","w"}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
+int main(int nargs, char * args[])
+{
+    string filename;
+    int njobs = 0;   // 0 for the plain serial render
+    bool incremental = false;
+    bool layout_only = false;
+    int first_page = 0;   // 0 for the whole book
+    int last_page = 0;
+    int chapter = -1;
+    int nvolumes = 0;
+    string output;
+    string index_filename;
+    string socket_path;
+    string manifest;
+    bool watching = false;
+    bool checking_relayout = false;
+    bool cover = false;
+    float paper_thickness = DEFAULT_PAPER_THICKNESS;
+
+    for (int ix = 1; ix < nargs; ix += 1) {
+        string arg = args[ix];
+        if (arg == "--parallel") njobs = max(1u, thread::hardware_concurrency());
+        else if (arg.substr(0,11) == "--parallel=") njobs = max(1, atoi(arg.substr(11).c_str()));
+        else if (arg == "--incremental") incremental = true;
+        else if (arg == "--watch") watching = true;
+        else if (arg == "--check-relayout") checking_relayout = true;
+        else if (arg == "--layout-only") layout_only = true;
+        else if (arg == "--native-pdf") output_format = NATIVE_PDF_OUTPUT;
+        else if (arg == "--svg") output_format = SVG_OUTPUT;
+        else if (arg == "--html") output_format = HTML_OUTPUT;
+        else if (arg == "--png") {
+            output_format = PNG_OUTPUT;
+            png_pages = true;
+        }
+        else if (arg == "--contact-sheet") {
+            output_format = PNG_OUTPUT;
+            png_contact_sheet = true;
+        }
+        else if (arg == "--hpgl") output_format = HPGL_OUTPUT;
+        else if (arg == "--gcode") output_format = GCODE_OUTPUT;
+        else if (arg.substr(0,6) == "--dpi=") {
+            png_dpi = atof(arg.substr(6).c_str());
+            if (png_dpi <= 0) die("bad dpi: " + arg.substr(6));
+        }
+        else if (arg.substr(0,8) == "--pages=") {
+            string range = arg.substr(8);
+            size_t dash = range.find('-');
+            first_page = atoi(range.substr(0, dash).c_str());
+            if (dash == string::npos) last_page = first_page;
+            else last_page = atoi(range.substr(dash+1).c_str());
+            if (first_page < 1 || last_page < first_page) die("bad page range: " + range);
+        }
+        else if (arg.substr(0,10) == "--chapter=") {
+            chapter = atoi(arg.substr(10).c_str());
+            if (chapter < 0) die("bad chapter: " + arg.substr(10));
+        }
+        else if (arg == "--cover") cover = true;
+        else if (arg.substr(0,18) == "--paper-thickness=") {
+            paper_thickness = atof(arg.substr(18).c_str());
+            if (paper_thickness <= 0) die("bad paper thickness: " + arg.substr(18));
+        }
+        else if (arg.substr(0,10) == "--volumes=") nvolumes = max(1, atoi(arg.substr(10).c_str()));
+        else if (arg.substr(0,9) == "--output=") output = arg.substr(9);
+        else if (arg.substr(0,8) == "--index=") index_filename = arg.substr(8);
+        else if (arg.substr(0,8) == "--serve=") socket_path = arg.substr(8);
+        else if (arg.substr(0,8) == "--batch=") manifest = arg.substr(8);
+        else if (arg.substr(0,8) == "--stats=") {
+            if (arg.substr(8) != "json") die("unknown stats format: " + arg.substr(8));
+            if (! stats_enabled()) die("--stats needs the timers built in: make STATS=1");
+            atexit(print_stats);
+        }
+        else if (arg.substr(0,8) == "--trace=") {
+            if (! start_trace(arg.substr(8))) die("--trace needs the timers built in: make STATS=1");
+            atexit(finish_trace);
+        }
+        else if (arg[0] == '-') die("unknown option: " + arg);
+        else if (filename.empty()) filename = arg;
+        else die("filename");
     }
+    if (filename.empty() && socket_path.empty() && manifest.empty()) die("filename");
 
-    y += 1;
-    x = 0;
-    for (string s : {"","","","TH","DH",""}) {
-        float nudge = s.length() > 1 ? 0.1 : 0;
-        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"","","","T","D",""}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
-    }
+    load_phonetic();
 
-    y += 1;
-    x = 0;
-    for (string s : {"T","D","N","S","Z","L"}) {
-        render_latin(s, target.margin+x*0.6, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"t","d","n","s","z","l"}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
+    if (! socket_path.empty()) {
+        serve(socket_path);
+        return 0;
     }
 
-    y += 1;
-    x = 0;
-    for (string s : {"","","","SH","ZH","R"}) {
-        float nudge = s.length() > 1 ? 0.1 : 0;
-        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"","","","S","Z","r"}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
+    // --parallel=N sets the number of books rendered at once
+    if (! manifest.empty()) {
+        if (! njobs) njobs = max(1u, thread::hardware_concurrency());
+        render_batch(manifest, njobs);
+        return 0;
     }
 
-    y += 1;
-    x = 0;
-    for (string s : {"K","G","NG","","","Y"}) {
-        float nudge = s.length() > 1 ? 0.1 : 0;
-        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"k","g","N","","","y"}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
-    }
+    // the plain serial render reads the book as it goes; everything else
+    // needs all of it at once
+    bool streamed = ! (layout_only || watching || nvolumes || first_page
+                       || chapter >= 0 || njobs || incremental
+                       || checking_relayout);
+    vector<para_t> book;
+    if (! streamed) book = load_book(filename);
 
-    y += 1;
-    x = 0;
-    for (string s : {"","","","H","",""}) {
-        float nudge = s.length() > 1 ? 0.1 : 0;
-        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"","","","h","",""}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
+    if (layout_only) {
+        // keep the word warnings out of the statistics
+        streambuf * saved = cout.rdbuf(nullptr);
+        ostringstream stats;
+        print_layout_stats(book, stats);
+        cout.rdbuf(saved);
+        cout.clear();
+        cout << stats.str();
+        return 0;
     }
 
-    y += 1;
-    render_latin("Vowels", target.margin, target.margin+fe.height + y *1.5*fe.height);
-
-    y += 1;
-    render_latin("Full words only", target.margin, target.margin+fe.height + y *1.5*fe.height);
-
-    y += 1;
-    x = 0;
-    for (string s : {"A","E","I","O","OO"}) {
-        float nudge = s.length() > 1 ? 0.1 : 0;
-        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"A","E","I","O","U"}) {
-        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
-        x += 1;
+    if (checking_relayout) {
+        check_relayout(book);
+        return 0;
     }
 
-    y += 1;
-    render_latin("Diacritics (optional if unambiguous)", target.margin, target.margin+fe.height+ y *1.5*fe.height);
-    set_skullbat_scale(3);
-
-    y += 1;
-    render_latin("monopthongs", target.margin, target.margin+fe.height+ y *1.5*fe.height);
-
-    int yy = 0;
-
-    y += 1;
+    if (njobs && incremental) die("--parallel and --incremental can't be combined");
 
-    x = 0;
-    yy = y;
-    for (string s : {"i","ɪ","e","ɛ","æ"}) {
-        render_latin("/"+s+"/", target.margin+x*1.0, target.margin+fe.height+ yy *1.5*fe.height);
-        yy += 1;
-    }
-    yy = y;
-    for (string s : {"i","I","e","E","A"}) {
-        if (s.length()) render_vowel(s, target.margin+x*1.0+te.width*2.5, target.margin+fe.height*2.0/3.0 + yy *1.5*fe.height);
-        yy += 1;
-    }
-    x = 1;
-    yy = y;
-    for (string s : {"","","ə","","a"}) {
-        if (s.length()) render_latin("/"+s+"/", target.margin+x*1.0, target.margin+fe.height+ yy *1.5*fe.height);
-        yy += 1;
-    }
-    yy = y;
-    for (string s : {"","","@","","a"}) {
-        if (s.length()) render_vowel(s, target.margin+x*1.0+te.width*2.5, target.margin+fe.height*2.0/3.0 + yy *1.5*fe.height);
-        yy += 1;
-    }
-    x = 2;
-    yy = y;
-    for (string s : {"u","ʊ","o","","ɒ"}) {
-        if (s.length()) render_latin("/"+s+"/", target.margin+x*1.0, target.margin+fe.height+ yy *1.5*fe.height);
-        yy += 1;
-    }
-    yy = y;
-    for (string s : {"u","U","o","","O"}) {
-        if (s.length()) render_vowel(s, target.margin+x*1.0+te.width*2.5, target.margin+fe.height*2.0/3.0 + yy *1.5*fe.height);
-        yy += 1;
+    // svg, png and plotter output go to abjad-<page>.svg and so on
+    if (output.empty()) {
+        if (output_format == SVG_OUTPUT) output = "abjad.svg";
+        else if (output_format == HTML_OUTPUT) output = "abjad.html";
+        else if (output_format == PNG_OUTPUT) output = "abjad.png";
+        else if (output_format == HPGL_OUTPUT) output = "abjad.hpgl";
+        else if (output_format == GCODE_OUTPUT) output = "abjad.gcode";
+        else output = "abjad.pdf";
     }
+    string cache_filename = output + ".cache";
+    if (! index_filename.empty()) cache_filename = index_filename;
 
-    y += 5;
-    render_latin("dipthongs", target.margin, target.margin+fe.height + y *1.5*fe.height);
-
-    y += 1;
-    x = 0;
-    for (string s : {"ei","ai","oi","au","ou"}) {
-        render_latin("/"+s+"/", target.margin+x*0.7, target.margin+fe.height+ y *1.5*fe.height);
-        x += 1;
-    }
-    x = 0;
-    for (string s : {"!e","!a","!o","^a","^o"}) {
-        render_vowel(s, target.margin+x*0.7+te.width*2.5, target.margin+fe.height*2.0/3.0 + y *1.5*fe.height);
-        x += 1;
+    if (watching) {
+        watch(book, filename, output, cache_filename);
+        return 0;
     }
 
-    set_skullbat_scale(1);
-}
-
-void load_phonetic() {
-    ifstream phonetics("pronunciation.txt");
-    string word, phonetic;
-    while (phonetics >> word >> phonetic) {
-        pronunciation[word] = phonetic;
+    if (nvolumes) {
+        if (output_format != CAIRO_PDF_OUTPUT && output_format != NATIVE_PDF_OUTPUT) {
+            die("--volumes only writes pdf");
+        }
+        render_volumes(book, filename, output, nvolumes, args[0], cache_filename);
+        return 0;
     }
-}
-
-vector<string> load_text(string filename) {
-    ifstream text(filename);
-    vector<string> lines;
-    string line;
-    while (getline(text, line)) lines.push_back(line);
-    return lines;
-}
-
-const string STARS = "* * * * *";
-
-int main(int nargs, char * args[])
-{
-    if (nargs != 2) die("filename");
-
-    load_phonetic();
 
-    vector<string> lines = load_text(args[1]);
-
-    vector<string> title_paras;
-    vector<string> rest_paras;
-
-    string para;
-    bool title_page = true;
-    for (string line : lines) {
-        if (line.substr(0,7) == "Chapter") title_page = false;
-
-        if (line.size()) para += line + " ";
-        else {
-            if (title_page) title_paras.push_back(para);
-            else rest_paras.push_back(para);
-            para.clear();
+    if (first_page || chapter >= 0) {
+        vector<para_record_t> index = layout_index(book, cache_filename);
+        if (chapter >= 0 && ! chapter_pages(book, index, chapter, first_page, last_page)) {
+            die("no chapter " + to_string(chapter));
         }
+        render_pages(book, index, first_page, last_page, output);
+        return 0;
     }
-    rest_paras.push_back(para);
-
-    target_t tgt("abjad.pdf");
-    skullbat_justification_context_t title(tgt, 7, 1);
-    skullbat_justification_context_t chap(tgt, 2);
-    skullbat_justification_context_t text(tgt);
 
-    for (string para : title_paras) title.render_columns(para);
-
-    for (string para : rest_paras) {
-        if (para.find(STARS) != string::npos) text.render_column_divider();
-        else if (para.substr(0,7) == "Chapter") {
-            tgt.new_page();
-            chap.render_columns(para);
-            text.set_column(3);
-        }
-        else text.render_columns(para);
+    if (cover && output_format != CAIRO_PDF_OUTPUT && output_format != NATIVE_PDF_OUTPUT) {
+        die("--cover only writes pdf");
     }
 
-    tgt.new_page();
+    int npages = 0;
+    if (njobs) render_parallel(book, output, njobs);
+    else if (incremental) render_incremental(book, output, cache_filename);
+    else npages = render_serial(filename, output);
 
-    keypage_context_t kp(tgt);
-    kp.render_key_page();
+    // the cover's spine is as thick as the book just rendered
+    if (cover) {
+        if (! npages) npages = measure_book(filename);
+        render_cover("cover.pdf", npages, paper_thickness);
+        cout << "cover.pdf for " << npages << " pages, spine "
+             << npages * paper_thickness << " in" << endl;
+    }
 
-    tgt.save_and_close();
     return 0;
 }
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "skullbat.h"
+
+using namespace std;
+
+// Microbenchmarks for the engine's hot functions.  The corpora are built
+// the same way every run from common_5000.txt and cmudict-0.7b, and each
+// result is the best of several timed batches, in ns per item, so runs on
+// different commits can be compared line by line.
+
+struct bench_t {
+    string name;
+    string unit;   // what one item is
+    size_t items;  // per call of run
+    function<void()> run;
+};
+
+// results are folded in here so the optimizer can't drop the work
+size_t bench_sink = 0;
+
+const int BATCHES = 5;
+const double MIN_BATCH_SECONDS = 0.05;
+
+double seconds_for(const bench_t & b, int reps) {
+    auto start = chrono::steady_clock::now();
+    for (int ix = 0; ix < reps; ix += 1) b.run();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// ns per item, the best over BATCHES batches long enough to time
+double time_bench(const bench_t & b) {
+    b.run();   // warm up
+
+    int reps = 1;
+    while (seconds_for(b, reps) < MIN_BATCH_SECONDS) reps *= 2;
+
+    double best = numeric_limits<double>::max();
+    for (int ix = 0; ix < BATCHES; ix += 1) {
+        best = min(best, seconds_for(b, reps) / reps);
+    }
+    return best * 1e9 / b.items;
+}
+
+// the words of common_5000.txt, most common first
+vector<string> load_common_words() {
+    ifstream in("common_5000.txt");
+    vector<string> words;
+    string line;
+    while (getline(in, line)) {
+        size_t space = line.find(' ');
+        if (space != string::npos) words.push_back(line.substr(0, space));
+    }
+    if (words.empty()) die("can't read common_5000.txt");
+    return words;
+}
+
+// cmudict-0.7b headwords spelled backwards, which the dictionary doesn't
+// know, so phoneticize_word goes all the way to its miss path
+vector<string> load_miss_words(size_t n) {
+    ifstream in("cmudict-0.7b");
+    vector<string> words;
+    string line;
+    for (size_t ix = 0; words.size() < n && getline(in, line); ix += 1) {
+        if (line.empty() || line[0] == ';' || ix % 20 != 0) continue;
+        string w = line.substr(0, line.find(' '));
+        w.assign(w.rbegin(), w.rend());
+        string key = pronunciation_key(w);
+        if (! key.empty() && ! pronunciation.count(key)) words.push_back(w);
+    }
+    if (words.empty()) die("can't read cmudict-0.7b");
+    return words;
+}
+
+// prose from the common words in turn, with the punctuation, digits and
+// emphasis the tokenizer handles, in paragraphs of 40 to 120 words
+vector<string> make_chapter(const vector<string> & words, size_t nwords) {
+    vector<string> paras;
+    string para;
+    size_t para_words = 0;
+    bool sentence_start = true;
+    for (size_t ix = 0; ix < nwords; ix += 1) {
+        string w = words[(ix * 7) % words.size()];
+        if (sentence_start) w[0] = toupper(w[0]);
+        if (ix % 97 == 0) w = to_string(1800 + ix % 200);
+        if (ix % 61 == 0) w = "_" + w + "_";
+
+        sentence_start = false;
+        if (ix % 13 == 12) {
+            w += ".";
+            sentence_start = true;
+        }
+        else if (ix % 5 == 4) w += ",";
+        else if (ix % 37 == 36) w += ";";
+
+        para += (para.empty() ? "" : " ") + w;
+        para_words += 1;
+        if (sentence_start && para_words >= 40 + (ix % 80)) {
+            paras.push_back(para);
+            para.clear();
+            para_words = 0;
+        }
+    }
+    if (! para.empty()) paras.push_back(para);
+    return paras;
+}
+
+size_t count_words(const vector<string> & paras) {
+    size_t n = 0;
+    for (const string & para : paras) n += split_words(para).size();
+    return n;
+}
+
+struct null_sink_t : page_sink_t {
+    void add_page(recorded_page_t &) {}
+};
+
+int main(int nargs, char * args[])
+{
+    // names to run, all of them if none given
+    vector<string> only(args + 1, args + nargs);
+
+    load_phonetic();
+    size_t nentries = pronunciation.size();
+    if (! nentries) die("can't read pronunciation.txt, run build_phonetic.py");
+
+    vector<string> common = load_common_words();
+    vector<string> misses = load_miss_words(common.size());
+    vector<string> chapter = make_chapter(common, 5000);
+    size_t chapter_words = count_words(chapter);
+
+    // a few common words aren't in the dictionary, and say so
+    streambuf * saved = cout.rdbuf(nullptr);
+    vector<string> phonetics;
+    for (const string & w : common) {
+        string p = phoneticize_word(w);
+        if (! p.empty()) phonetics.push_back(p);
+    }
+    cout.rdbuf(saved);
+    cout.clear();
+
+    // a page-sized image at 100 dpi, and one with no pixels at all, where
+    // every path is clipped away before it is rasterized
+    cairo_surface_t * image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 550, 850);
+    cairo_surface_t * empty = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
+
+    target_t image_tgt(image);
+    sb_t image_sb(image_tgt);
+    cairo_scale(image_sb.cr, 100.0 / POINTS_PER_INCH, 100.0 / POINTS_PER_INCH);
+
+    target_t empty_tgt(empty);
+    sb_t empty_sb(empty_tgt);
+
+    auto render_words = [&](sb_t & sb) {
+        for (const string & p : phonetics) {
+            sb.spinex = 2.75;
+            sb.leftx = sb.spinex - sb.step;
+            sb.rightx = sb.spinex + sb.step;
+            sb.markx = sb.rightx + sb.halfstep;
+            sb.starty = 1;
+            sb.render_phonetic_word(p);
+        }
+    };
+
+    target_t measure_tgt(MEASURE_TARGET);
+    measure_tgt.new_page();
+    sbj_t measure_sbj(measure_tgt);
+
+    null_sink_t null_sink;
+    target_t record_tgt(RECORD_TARGET, & null_sink);
+    record_tgt.new_page();
+    sbj_t record_sbj(record_tgt);
+
+    vector<bench_t> benches = {
+        {"split_words", "word", chapter_words, [&] {
+            for (const string & para : chapter) bench_sink += split_words(para).size();
+        }},
+        {"phoneticize_word/hit", "word", common.size(), [&] {
+            for (const string & w : common) bench_sink += phoneticize_word(w).size();
+        }},
+        {"phoneticize_word/miss", "word", misses.size(), [&] {
+            for (const string & w : misses) bench_sink += phoneticize_word(w).size();
+        }},
+        {"load_phonetic", "entry", nentries, [&] {
+            load_phonetic();
+            bench_sink += pronunciation.size();
+        }},
+        {"size_phonetic_word", "word", phonetics.size(), [&] {
+            for (const string & p : phonetics) bench_sink += empty_sb.size_phonetic_word(p);
+        }},
+        {"render_phonetic_word/image", "word", phonetics.size(), [&] {
+            render_words(image_sb);
+        }},
+        {"render_phonetic_word/null", "word", phonetics.size(), [&] {
+            render_words(empty_sb);
+        }},
+        {"split_vowels", "word", phonetics.size(), [&] {
+            for (const string & p : phonetics) bench_sink += split_vowels(p).size();
+        }},
+        {"render_columns/measure", "word", chapter_words, [&] {
+            for (const string & para : chapter) measure_sbj.render_columns(para);
+        }},
+        {"render_columns/record", "word", chapter_words, [&] {
+            for (const string & para : chapter) record_sbj.render_columns(para);
+        }},
+    };
+
+    for (const bench_t & b : benches) {
+        if (! only.empty() && find(only.begin(), only.end(), b.name) == only.end()) continue;
+
+        // keep the miss path's warnings out of the results
+        saved = cout.rdbuf(nullptr);
+        double ns = time_bench(b);
+        cout.rdbuf(saved);
+        cout.clear();
+
+        cout << left << setw(28) << b.name << right << fixed << setprecision(1)
+             << setw(12) << ns << " ns/" << b.unit << endl;
+    }
+
+    record_tgt.discard_page();
+    image_tgt.save_and_close();
+    empty_tgt.save_and_close();
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <cairo.h>
+}
+
+using namespace std;
+
+// A page's drawing captured as device-space paths (in points), so it can be
+// built on one thread and replayed onto a real surface on another.
+
+enum dl_kind_t : uint8_t {
+    DL_STROKE,
+    DL_FILL,
+    DL_IMAGE,
+
+    // bracket the ops drawing one phonetic word, so backends that can
+    // reuse shapes draw each distinct word once
+    DL_BEGIN_GLYPH,
+    DL_END_GLYPH,
+
+    // bracket the outline of a run of latin text, so a cairo pdf can show
+    // the text itself and keep it selectable
+    DL_BEGIN_TEXT,
+    DL_END_TEXT,
+};
+
+enum dl_verb_t : uint8_t {
+    DL_MOVE_TO,
+    DL_LINE_TO,
+    DL_CURVE_TO,
+    DL_CLOSE_PATH,
+};
+
+struct dl_op_t {
+    dl_kind_t kind;
+    uint8_t line_cap;
+    uint8_t line_join;
+
+    float red;
+    float green;
+    float blue;
+    float line_width;
+
+    // path ops use verbs and coords, image ops use six coords for the
+    // matrix and name for the png file, glyph ops use two coords for the
+    // word's origin and name for a key naming its shape, text ops use six
+    // coords for the origin and font matrix, name and name+1 for the text
+    // and font family, and line_cap and line_join for its slant and weight
+    uint32_t first_verb;
+    uint32_t nverbs;
+    uint32_t first_coord;
+    uint32_t name;
+};
+
+struct display_list_t {
+    vector<dl_op_t> ops;
+    vector<uint8_t> verbs;
+    vector<float> coords;
+    vector<string> names;
+
+    void clear();
+    void add_path(dl_kind_t kind, cairo_t * cr);
+    void add_image(string name, cairo_t * cr);
+    void begin_glyph(string key, cairo_t * cr, double x, double y);
+    void end_glyph();
+    void begin_text(string text, cairo_t * cr);
+    void end_text();
+    void append(const display_list_t & other);
+    void replay(cairo_t * cr, bool show_text=false) const;
+
+    // whether every op's indices are within the arrays
+    bool valid() const;
+};
+
+struct recorded_page_t {
+    int page_number;
+    display_list_t dl;
+};
+
+// receives finished pages from a recording target, in page order
+struct page_sink_t {
+    virtual void add_page(recorded_page_t & page) = 0;
+    virtual void finish() {}
+    virtual ~page_sink_t() {}
+};
@@ -0,0 +1,124 @@
+# Writes a synthetic book of a given number of words for scale testing, in
+# the format abjad reads: a title page, "Chapter N" headings, paragraphs
+# separated by blank lines and wrapped at 70 columns, "* * * * *" dividers,
+# and the punctuation, digits and _emphasis_ the tokenizer handles.
+#
+#   python3 make_corpus.py <words> [<output>] [--seed=N]
+#
+# Words are drawn from common_5000.txt by rank with Zipf's law (the list
+# is in frequency order but has no counts).  Once build_phonetic.py has
+# run, words missing from pronunciation.txt are left out.  The same
+# arguments always give the same book.
+
+import random
+import sys
+import textwrap
+
+STARS = "* * * * *"
+
+args = [a for a in sys.argv[1:] if not a.startswith("--seed=")]
+seeds = [a for a in sys.argv[1:] if a.startswith("--seed=")]
+if not 1 <= len(args) <= 2:
+    sys.exit("usage: make_corpus.py <words> [<output>] [--seed=N]")
+nwords = int(args[0])
+output = args[1] if len(args) > 1 else "corpus.txt"
+seed = int(seeds[-1][7:]) if seeds else nwords
+
+# "chapter" would turn a paragraph that starts with it into a heading
+words = [line.split()[0] for line in open("common_5000.txt") if line.strip()]
+words = [w for w in words if w.lower() != "chapter"]
+try:
+    # word/phonetic pairs, read the way load_phonetic() reads them
+    known = set(open("pronunciation.txt").read().split()[0::2])
+    words = [w for w in words if w.lower() in known]
+except FileNotFoundError:
+    pass
+
+cum_weights = []
+total = 0
+for rank in range(1, len(words) + 1):
+    total += 1.0 / rank
+    cum_weights.append(total)
+
+rng = random.Random(seed)
+written = 0
+
+# words are drawn in blocks, which is several times faster than one at a time
+pool = []
+def word():
+    global pool
+    if not pool:
+        pool = rng.choices(words, cum_weights=cum_weights, k=4096)
+    return pool.pop()
+
+def number():
+    kind = rng.random()
+    if kind < 0.4: return str(rng.randint(1700, 1999))
+    if kind < 0.8: return str(rng.randint(2, 99))
+    return str(rng.randint(100, 99999))
+
+def sentence():
+    global written
+    n = min(rng.randint(5, 30), nwords - written)
+    written += n
+
+    ws = []
+    emphasis = 0
+    for ix in range(n):
+        w = number() if rng.random() < 0.01 else word()
+        if ix == 0: w = w[0].upper() + w[1:]
+        elif written < nwords and rng.random() < 0.005:
+            # the title is a word of its own
+            w = rng.choice(["Mr.", "Mrs.", "St."]) + " " + w[0].upper() + w[1:]
+            written += 1
+
+        if emphasis == 0 and rng.random() < 0.01:
+            emphasis = rng.randint(1, 3)
+            w = "_" + w
+        if emphasis:
+            emphasis -= 1
+            if emphasis == 0 or ix == n - 1:
+                emphasis = 0
+                w = w + "_"
+
+        if ix < n - 1:
+            mark = rng.random()
+            if mark < 0.06: w += ","
+            elif mark < 0.07: w += ";"
+            elif mark < 0.075: w += ":"
+            elif mark < 0.085: w += "--"
+        ws.append(w)
+
+    if len(ws) > 4 and rng.random() < 0.02:
+        start = rng.randint(1, len(ws) - 3)
+        ws[start] = "(" + ws[start]
+        ws[start + 1] = ws[start + 1].rstrip(",;:-") + ")"
+
+    end = rng.random()
+    return " ".join(ws) + ("." if end < 0.85 else "?" if end < 0.93 else "!")
+
+def paragraph():
+    ss = []
+    for ix in range(rng.randint(1, 8)):
+        if written >= nwords: break
+        ss.append(sentence())
+    text = " ".join(ss)
+    if rng.random() < 0.25: text = '"' + text + '"'
+    return text
+
+with open(output, "w") as out:
+    def write_para(text):
+        lines = textwrap.wrap(text, 70, break_on_hyphens=False)
+        out.write("\n".join(lines) + "\n\n")
+
+    write_para("A BOOK OF {} WORDS".format(nwords))
+    write_para("By A Machine")
+
+    chapter = 0
+    while written < nwords:
+        chapter += 1
+        write_para("Chapter {}".format(chapter))
+        chapter_end = min(written + rng.randint(1500, 6000), nwords)
+        while written < chapter_end:
+            write_para(paragraph())
+            if rng.random() < 0.01: write_para(STARS)
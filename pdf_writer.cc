@@ -0,0 +1,621 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include <zlib.h>
+
+#include "pdf_writer.h"
+
+using namespace std;
+
+const float POINTS_PER_INCH = 72.0;
+
+// fixed objects, the rest are numbered as they are written
+const uint32_t CATALOG_OBJECT = 1;
+const uint32_t PAGES_OBJECT = 2;
+const uint32_t RESOURCES_OBJECT = 3;
+
+string flate(const string & data, bool fast) {
+    uLongf size = compressBound(data.size());
+    string out(size, '\0');
+    compress2((Bytef *) & out[0], & size, (const Bytef *) data.data(),
+              data.size(), fast ? Z_BEST_SPEED : Z_DEFAULT_COMPRESSION);
+    out.resize(size);
+    return out;
+}
+
+string inflate(const string & data) {
+    z_stream z = {};
+    inflateInit(& z);
+    z.next_in = (Bytef *) data.data();
+    z.avail_in = data.size();
+
+    string out;
+    char buffer[65536];
+    int status;
+    do {
+        z.next_out = (Bytef *) buffer;
+        z.avail_out = sizeof(buffer);
+        status = inflate(& z, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - z.avail_out);
+    } while (status == Z_OK);
+    inflateEnd(& z);
+
+    return out;
+}
+
+void append_number(string & s, double v, int places) {
+    long long scale = 1;
+    for (int ix = 0; ix < places; ix += 1) scale *= 10;
+
+    long long n = llround(v * scale);
+    if (n < 0) {
+        s.push_back('-');
+        n = -n;
+    }
+
+    char digits[24];
+    int len = 0;
+    long long whole = n / scale;
+    do {
+        digits[len++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole);
+    while (len) s.push_back(digits[--len]);
+
+    long long frac = n % scale;
+    if (frac) {
+        s.push_back('.');
+        for (long long digit = scale / 10; frac; digit /= 10) {
+            s.push_back('0' + frac / digit);
+            frac %= digit;
+        }
+    }
+}
+
+void append_op(string & s, const char * op) {
+    s.push_back(' ');
+    s += op;
+    s.push_back('\n');
+}
+
+void append_numbers(string & s, const float * c, int n, int places=2) {
+    for (int ix = 0; ix < n; ix += 1) {
+        if (ix) s.push_back(' ');
+        append_number(s, c[ix], places);
+    }
+}
+
+pdf_writer_t::pdf_writer_t(string filename, float width, float height)
+        : out(filename, ios::binary) {
+    start(width, height);
+}
+
+// the pdf is appended to bytes, for callers that send it on rather than
+// keep it
+pdf_writer_t::pdf_writer_t(string * bytes, float width, float height) {
+    memory = bytes;
+    start(width, height);
+}
+
+void pdf_writer_t::start(float width, float height) {
+    paper_width = width * POINTS_PER_INCH;
+    paper_height = height * POINTS_PER_INCH;
+
+    xref.push_back(xref_entry_t{false, 0});   // the free list head
+    new_object();   // catalog
+    new_object();   // page tree
+    new_object();   // resources
+
+    write("%PDF-1.5\n%\xe2\xe3\xcf\xd3\n");
+}
+
+uint32_t pdf_writer_t::new_object() {
+    xref.push_back(xref_entry_t{false, 0});
+    return xref.size() - 1;
+}
+
+void pdf_writer_t::write(const string & data) {
+    if (memory) memory->append(data);
+    else out.write(data.data(), data.size());
+    offset += data.size();
+}
+
+// dict is the stream dictionary without its brackets or length
+void pdf_writer_t::write_stream(uint32_t number, string dict,
+                                const string & data) {
+    xref[number].offset = offset;
+    write(to_string(number) + " 0 obj\n<<" + dict + "/Length "
+          + to_string(data.size()) + ">>\nstream\n");
+    write(data);
+    write("\nendstream\nendobj\n");
+}
+
+void pdf_writer_t::pack(uint32_t number, string body) {
+    xref[number].packed = true;
+    xref[number].offset = packed.size();
+    packed.push_back(body);
+    packed_numbers.push_back(number);
+}
+
+void pdf_writer_t::add_page(recorded_page_t & page) {
+    const display_list_t & dl = page.dl;
+
+    // flip to cairo's top-down device space, which the display list uses
+    content = "1 0 0 -1 0 ";
+    append_number(content, paper_height);
+    append_op(content, "cm");
+
+    // only emit graphics state that changes
+    float stroke_rgb[3] = {-1, -1, -1};
+    float fill_rgb[3] = {-1, -1, -1};
+    float line_width = -1;
+    int line_cap = -1;
+    int line_join = -1;
+
+    for (const dl_op_t & op : dl.ops) {
+        const float * c = & dl.coords[op.first_coord];
+
+        if (op.kind == DL_IMAGE) {
+            pdf_image_t image = image_object(dl.names[op.name]);
+            if (! image.object) continue;
+
+            // images are drawn in pixel units, top row first, but image
+            // space is the unit square with the top row at 1
+            content += "q ";
+            append_numbers(content, c, 6, 5);
+            append_op(content, "cm");
+            content += to_string(image.width) + " 0 0 -" + to_string(image.height)
+                + " 0 " + to_string(image.height) + " cm /I"
+                + to_string(image.object) + " Do Q\n";
+            continue;
+        }
+        // text is drawn by its outline, which follows its begin marker
+        if (op.kind == DL_BEGIN_GLYPH || op.kind == DL_END_GLYPH
+            || op.kind == DL_BEGIN_TEXT || op.kind == DL_END_TEXT) {
+            continue;
+        }
+
+        float rgb[3] = {op.red, op.green, op.blue};
+        float * current = op.kind == DL_STROKE ? stroke_rgb : fill_rgb;
+        if (! equal(rgb, rgb+3, current)) {
+            copy(rgb, rgb+3, current);
+            append_numbers(content, rgb, 3);
+            append_op(content, op.kind == DL_STROKE ? "RG" : "rg");
+        }
+
+        if (op.kind == DL_STROKE) {
+            if (op.line_width != line_width) {
+                line_width = op.line_width;
+                append_number(content, line_width);
+                append_op(content, "w");
+            }
+            // cairo's cap and join enums are in pdf's order
+            if (op.line_cap != line_cap) {
+                line_cap = op.line_cap;
+                append_number(content, line_cap);
+                append_op(content, "J");
+            }
+            if (op.line_join != line_join) {
+                line_join = op.line_join;
+                append_number(content, line_join);
+                append_op(content, "j");
+            }
+        }
+
+        for (uint32_t ix = 0; ix < op.nverbs; ix += 1) {
+            switch (dl.verbs[op.first_verb + ix]) {
+            case DL_MOVE_TO:
+                append_numbers(content, c, 2);
+                append_op(content, "m");
+                c += 2;
+                break;
+            case DL_LINE_TO:
+                append_numbers(content, c, 2);
+                append_op(content, "l");
+                c += 2;
+                break;
+            case DL_CURVE_TO:
+                append_numbers(content, c, 6);
+                append_op(content, "c");
+                c += 6;
+                break;
+            case DL_CLOSE_PATH:
+                content += "h\n";
+                break;
+            }
+        }
+
+        content += op.kind == DL_STROKE ? "S\n" : "f\n";
+    }
+
+    uint32_t contents = new_object();
+    write_stream(contents, "/Filter/FlateDecode", flate(content, fast));
+
+    pack_page(contents, RESOURCES_OBJECT, page.page_number);
+}
+
+void pdf_writer_t::pack_page(uint32_t contents, uint32_t resources,
+                             int page_number) {
+    uint32_t page_object = new_object();
+    pack(page_object, "<</Type/Page/Parent 2 0 R/Resources "
+                      + to_string(resources) + " 0 R/Contents "
+                      + to_string(contents) + " 0 R>>");
+    page_objects.push_back(page_object);
+    page_numbers.push_back(page_number);
+}
+
+uint32_t read_be32(const string & data, size_t at) {
+    return (uint8_t) data[at] << 24 | (uint8_t) data[at+1] << 16
+        | (uint8_t) data[at+2] << 8 | (uint8_t) data[at+3];
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// Writes an 8 bit non-interlaced png as an image xobject, with its alpha
+// channel as a soft mask.
+pdf_image_t pdf_writer_t::image_object(string name) {
+    auto found = images.find(name);
+    if (found != images.end()) return found->second;
+    images[name] = pdf_image_t{0, 0, 0};
+
+    ifstream in(name, ios::binary);
+    string png((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (png.size() < 8 || png.compare(0, 8, "\x89PNG\r\n\x1a\n")) {
+        cout << "can't read png: " << name << endl;
+        return images[name];
+    }
+
+    uint32_t width = 0, height = 0;
+    int depth = 0, color_type = 0, interlace = 0;
+    string idat;
+    for (size_t at = 8; at + 8 <= png.size(); ) {
+        uint32_t len = read_be32(png, at);
+        string type = png.substr(at+4, 4);
+        if (at + 12 + len > png.size()) break;
+
+        if (type == "IHDR") {
+            width = read_be32(png, at+8);
+            height = read_be32(png, at+12);
+            depth = (uint8_t) png[at+16];
+            color_type = (uint8_t) png[at+17];
+            interlace = (uint8_t) png[at+20];
+        }
+        else if (type == "IDAT") idat += png.substr(at+8, len);
+        else if (type == "IEND") break;
+
+        at += 12 + len;
+    }
+
+    size_t channels;
+    switch (color_type) {
+    case 0: channels = 1; break;   // grey
+    case 2: channels = 3; break;   // rgb
+    case 4: channels = 2; break;   // grey, alpha
+    case 6: channels = 4; break;   // rgba
+    default: channels = 0; break;
+    }
+    if (! width || ! height || depth != 8 || ! channels || interlace) {
+        cout << "unsupported png: " << name << endl;
+        return images[name];
+    }
+
+    size_t stride = width * channels;
+    uLongf size = height * (stride + 1);
+    string raw(size, '\0');
+    if (uncompress((Bytef *) & raw[0], & size, (const Bytef *) idat.data(),
+                   idat.size()) != Z_OK || size != raw.size()) {
+        cout << "bad png data: " << name << endl;
+        return images[name];
+    }
+
+    // undo the per-row filters in place, then split off the alpha
+    bool has_alpha = channels == 2 || channels == 4;
+    int colors = has_alpha ? channels - 1 : channels;
+    string color;
+    string alpha;
+    color.reserve(width * height * colors);
+    if (has_alpha) alpha.reserve(width * height);
+
+    for (uint32_t y = 0; y < height; y += 1) {
+        uint8_t * row = (uint8_t *) & raw[y * (stride + 1)];
+        uint8_t filter = row[0];
+        row += 1;
+        uint8_t * prev = y ? row - (stride + 1) : nullptr;
+
+        for (size_t x = 0; x < stride; x += 1) {
+            int a = x >= channels ? row[x - channels] : 0;
+            int b = prev ? prev[x] : 0;
+            int c = prev && x >= channels ? prev[x - channels] : 0;
+            switch (filter) {
+            case 1: row[x] += a; break;
+            case 2: row[x] += b; break;
+            case 3: row[x] += (a + b) / 2; break;
+            case 4: row[x] += paeth(a, b, c); break;
+            default: break;
+            }
+        }
+
+        for (size_t x = 0; x < stride; x += channels) {
+            color.append((char *) row + x, colors);
+            if (has_alpha) alpha.push_back(row[x + colors]);
+        }
+    }
+
+    string dict = "/Type/XObject/Subtype/Image/Width " + to_string(width)
+        + "/Height " + to_string(height) + "/BitsPerComponent 8";
+
+    uint32_t mask = 0;
+    if (has_alpha) {
+        mask = new_object();
+        write_stream(mask, dict + "/ColorSpace/DeviceGray/Filter/FlateDecode",
+                     flate(alpha));
+    }
+
+    uint32_t image = new_object();
+    string image_dict = dict + (colors == 3 ? "/ColorSpace/DeviceRGB"
+                                            : "/ColorSpace/DeviceGray")
+        + "/Filter/FlateDecode";
+    if (mask) image_dict += "/SMask " + to_string(mask) + " 0 R";
+    write_stream(image, image_dict, flate(color));
+
+    images[name] = pdf_image_t{image, width, height};
+    return images[name];
+}
+
+void pdf_writer_t::finish() {
+    string xobjects;
+    for (auto & named : images) {
+        if (! named.second.object) continue;
+        string number = to_string(named.second.object);
+        xobjects += "/I" + number + " " + number + " 0 R";
+    }
+    pack(RESOURCES_OBJECT, "<</XObject<<" + xobjects + ">>>>");
+
+    string kids;
+    for (uint32_t page_object : page_objects) {
+        if (! kids.empty()) kids += " ";
+        kids += to_string(page_object) + " 0 R";
+    }
+    string media_box;
+    append_number(media_box, paper_width);
+    media_box += " ";
+    append_number(media_box, paper_height);
+    pack(PAGES_OBJECT, "<</Type/Pages/Count " + to_string(page_objects.size())
+                       + "/Kids[" + kids + "]/MediaBox[0 0 " + media_box + "]>>");
+
+    // label pages with their book page numbers wherever they don't simply
+    // count up from 1
+    string labels;
+    for (size_t ix = 0; ix < page_numbers.size(); ix += 1) {
+        int expected = ix ? page_numbers[ix-1] + 1 : 1;
+        if (page_numbers[ix] == expected) continue;
+        labels += to_string(ix) + "<</S/D/St " + to_string(page_numbers[ix]) + ">>";
+    }
+    if (! labels.empty()) {
+        if (page_numbers[0] == 1) labels = "0<</S/D>>" + labels;
+        labels = "/PageLabels<</Nums[" + labels + "]>>";
+    }
+    pack(CATALOG_OBJECT, "<</Type/Catalog/Pages 2 0 R" + labels + ">>");
+
+    uint32_t object_stream = new_object();
+    string header;
+    string bodies;
+    for (size_t ix = 0; ix < packed.size(); ix += 1) {
+        header += to_string(packed_numbers[ix]) + " " + to_string(bodies.size()) + " ";
+        bodies += packed[ix] + "\n";
+    }
+    write_stream(object_stream, "/Type/ObjStm/N " + to_string(packed.size())
+                                + "/First " + to_string(header.size())
+                                + "/Filter/FlateDecode",
+                 flate(header + bodies));
+
+    // each entry is a type byte, then a 4 byte offset or object stream,
+    // then a 4 byte generation or index
+    uint32_t xref_stream = new_object();
+    xref[xref_stream].offset = offset;
+
+    string entries;
+    for (size_t ix = 0; ix < xref.size(); ix += 1) {
+        uint8_t type = ix == 0 ? 0 : xref[ix].packed ? 2 : 1;
+        uint64_t field2 = xref[ix].packed ? object_stream : xref[ix].offset;
+        uint64_t field3 = ix == 0 ? 65535 : xref[ix].packed ? xref[ix].offset : 0;
+        entries.push_back(type);
+        for (int shift = 24; shift >= 0; shift -= 8) entries.push_back(field2 >> shift);
+        for (int shift = 24; shift >= 0; shift -= 8) entries.push_back(field3 >> shift);
+    }
+
+    uint64_t startxref = offset;
+    write_stream(xref_stream, "/Type/XRef/Size " + to_string(xref.size())
+                              + "/W[1 4 4]/Root 1 0 R/Filter/FlateDecode",
+                 flate(entries));
+    write("startxref\n" + to_string(startxref) + "\n%%EOF\n");
+
+    if (! memory) out.close();
+}
+
+// the integer after key in text, or -1
+long long dict_int(const string & text, string key) {
+    size_t at = text.find(key);
+    if (at == string::npos) return -1;
+    return atoll(text.c_str() + at + key.size());
+}
+
+// object numbers of the "N 0 R" references in text
+vector<uint32_t> references(const string & text) {
+    vector<uint32_t> numbers;
+    for (size_t at = text.find(" 0 R"); at != string::npos; at = text.find(" 0 R", at + 1)) {
+        size_t start = at;
+        while (start > 0 && isdigit(text[start-1])) start -= 1;
+        numbers.push_back(atoi(text.c_str() + start));
+    }
+    return numbers;
+}
+
+// Only reads what pdf_writer_t writes: streams at top level, everything
+// else in object streams, and an xref stream.
+struct pdf_reader_t {
+    string pdf;
+    vector<uint8_t> types;
+    vector<uint64_t> fields;   // offset, or object stream number
+    vector<uint32_t> indexes;  // index within the object stream
+    map<uint32_t, pair<string, vector<size_t>>> object_streams;
+
+    bool open(string filename);
+    bool stream(uint32_t number, string & dict, string & data);
+    string object(uint32_t number);
+};
+
+// reads the stream object at offset, returning false if it isn't one
+bool read_stream(const string & pdf, uint64_t offset, string & dict,
+                 string & data) {
+    size_t start = pdf.find("<<", offset);
+    size_t end = pdf.find(">>\nstream\n", offset);
+    if (start == string::npos || end == string::npos) return false;
+
+    dict = pdf.substr(start + 2, end - start - 2);
+    long long length = dict_int(dict, "/Length ");
+    size_t data_start = end + 10;
+    if (length < 0 || data_start + length > pdf.size()) return false;
+    data = pdf.substr(data_start, length);
+    return true;
+}
+
+bool pdf_reader_t::open(string filename) {
+    ifstream in(filename, ios::binary);
+    pdf.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+
+    size_t at = pdf.rfind("startxref");
+    if (at == string::npos) return false;
+
+    string dict, data;
+    if (! read_stream(pdf, atoll(pdf.c_str() + at + 10), dict, data)) return false;
+    if (dict.find("/W[1 4 4]") == string::npos) return false;
+    data = inflate(data);
+
+    for (size_t ix = 0; ix + 9 <= data.size(); ix += 9) {
+        const uint8_t * entry = (const uint8_t *) & data[ix];
+        types.push_back(entry[0]);
+        fields.push_back((uint64_t) entry[1] << 24 | entry[2] << 16 | entry[3] << 8 | entry[4]);
+        indexes.push_back(entry[5] << 24 | entry[6] << 16 | entry[7] << 8 | entry[8]);
+    }
+    return true;
+}
+
+bool pdf_reader_t::stream(uint32_t number, string & dict, string & data) {
+    if (number >= types.size() || types[number] != 1) return false;
+    return read_stream(pdf, fields[number], dict, data);
+}
+
+// the body of a packed object
+string pdf_reader_t::object(uint32_t number) {
+    if (number >= types.size() || types[number] != 2) return "";
+
+    uint32_t container = fields[number];
+    if (! object_streams.count(container)) {
+        string dict, data;
+        if (! stream(container, dict, data)) return "";
+        data = inflate(data);
+
+        // the header is pairs of object number and offset after /First
+        long long first = dict_int(dict, "/First ");
+        long long count = dict_int(dict, "/N ");
+        istringstream header(data.substr(0, first));
+        vector<size_t> offsets;
+        for (long long ix = 0; ix < count; ix += 1) {
+            size_t object_number, offset;
+            header >> object_number >> offset;
+            offsets.push_back(first + offset);
+        }
+        offsets.push_back(data.size());
+        object_streams[container] = {data, offsets};
+    }
+
+    auto & unpacked = object_streams[container];
+    uint32_t index = indexes[number];
+    if (index + 1 >= unpacked.second.size()) return "";
+    size_t start = unpacked.second[index];
+    return unpacked.first.substr(start, unpacked.second[index + 1] - start);
+}
+
+// copies a stream object, and the soft mask of an image, returning its
+// number in out
+uint32_t copy_stream(pdf_writer_t & out, pdf_reader_t & in, uint32_t number,
+                     map<uint32_t, uint32_t> & renumbered) {
+    if (renumbered.count(number)) return renumbered[number];
+
+    string dict, data;
+    if (! in.stream(number, dict, data)) return 0;
+
+    // write_stream() adds the length back
+    dict = dict.substr(0, dict.find("/Length "));
+
+    size_t mask_at = dict.find("/SMask ");
+    if (mask_at != string::npos) {
+        uint32_t mask = copy_stream(out, in, atoi(dict.c_str() + mask_at + 7),
+                                    renumbered);
+        size_t mask_end = dict.find(" 0 R", mask_at) + 4;
+        dict = dict.substr(0, mask_at) + "/SMask " + to_string(mask) + " 0 R"
+            + dict.substr(mask_end);
+    }
+
+    uint32_t copy = out.new_object();
+    out.write_stream(copy, dict, data);
+    renumbered[number] = copy;
+    return copy;
+}
+
+bool pdf_writer_t::append_pdf(string filename, int first_page_number) {
+    pdf_reader_t in;
+    if (! in.open(filename)) return false;
+
+    string catalog = in.object(CATALOG_OBJECT);
+    long long pages_number = dict_int(catalog, "/Pages ");
+    if (pages_number < 0) return false;
+    string pages = in.object(pages_number);
+    size_t kids = pages.find("/Kids[");
+    if (kids == string::npos) return false;
+    vector<uint32_t> page_list =
+        references(pages.substr(kids, pages.find(']', kids) - kids));
+
+    // content streams name images by their object number in the file they
+    // came from, so each file's images keep their names under a resource
+    // dictionary of the file's own
+    map<uint32_t, uint32_t> renumbered;
+    string old_resources = in.object(RESOURCES_OBJECT);
+    string xobjects;
+    size_t at = old_resources.find("/XObject<<");
+    size_t end = old_resources.find(">>", at);
+    if (at != string::npos) at = old_resources.find('/', at + 1);
+    while (at != string::npos && at < end) {
+        size_t space = old_resources.find(' ', at);
+        string name = old_resources.substr(at, space - at);
+        uint32_t image = copy_stream(* this, in, atoi(old_resources.c_str() + space + 1),
+                                     renumbered);
+        xobjects += name + " " + to_string(image) + " 0 R";
+        at = old_resources.find('/', space);
+    }
+    uint32_t resources = new_object();
+    pack(resources, "<</XObject<<" + xobjects + ">>>>");
+
+    for (size_t ix = 0; ix < page_list.size(); ix += 1) {
+        string page = in.object(page_list[ix]);
+        long long contents = dict_int(page, "/Contents ");
+        if (contents < 0) return false;
+        pack_page(copy_stream(* this, in, contents, renumbered), resources,
+                  first_page_number + ix);
+    }
+
+    return true;
+}
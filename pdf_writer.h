@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "display_list.h"
+
+using namespace std;
+
+// Writes recorded pages straight to a PDF 1.5 file: Flate-compressed
+// content streams, the small dictionaries packed into one object stream,
+// and an xref stream.  Needs only zlib.
+
+struct pdf_image_t {
+    uint32_t object;   // 0 if the png couldn't be used
+    uint32_t width;
+    uint32_t height;
+};
+
+struct pdf_writer_t : page_sink_t {
+    ofstream out;
+    string * memory = nullptr;   // written to instead of out when set
+    uint64_t offset = 0;
+
+    float paper_width;    // in points
+    float paper_height;
+
+    // objects written at top level by offset, or packed into the object
+    // stream by index
+    struct xref_entry_t {
+        bool packed;
+        uint64_t offset;
+    };
+    vector<xref_entry_t> xref;
+    vector<string> packed;   // bodies of packed objects, in object order
+    vector<uint32_t> packed_numbers;
+
+    vector<uint32_t> page_objects;
+    vector<int> page_numbers;
+    map<string, pdf_image_t> images;   // by png file name
+
+    string content;   // scratch for the page being written
+    bool fast = false;   // compress page contents quickly rather than tightly
+
+    pdf_writer_t(string filename, float width=5.5, float height=8.5);
+    pdf_writer_t(string * bytes, float width=5.5, float height=8.5);
+
+    void add_page(recorded_page_t & page);
+    void finish();
+
+    // copies the pages of a pdf written by pdf_writer_t, numbering them
+    // from first_page_number
+    bool append_pdf(string filename, int first_page_number);
+
+    void start(float width, float height);
+    uint32_t new_object();
+    void write(const string & data);
+    void write_stream(uint32_t number, string dict, const string & data);
+    void pack(uint32_t number, string body);
+    void pack_page(uint32_t contents, uint32_t resources, int page_number);
+    pdf_image_t image_object(string name);
+};
+
+// deflates and inflates data with zlib, at its fastest level if fast
+string flate(const string & data, bool fast=false);
+string inflate(const string & data);
+
+// appends v rounded to some decimal places, without trailing zeros
+void append_number(string & s, double v, int places=2);
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include "plot_writer.h"
+
+using namespace std;
+
+const float POINTS_PER_INCH = 72.0;
+const double MM_PER_POINT = 25.4 / POINTS_PER_INCH;
+
+// for estimating plot time
+const double DRAW_SPEED = 25;     // mm/s with the pen down
+const double TRAVEL_SPEED = 75;   // mm/s with the pen up
+const double PEN_LIFT_TIME = 0.2;   // seconds to lift and drop the pen
+
+const float FLATNESS = 0.5;   // points per segment when flattening curves
+const float TOUCH = 0.01;     // points apart for stroke ends to count as touching
+
+// 2-opt only tries reversing runs of up to this many strokes
+const int TWO_OPT_WINDOW = 200;
+const int TWO_OPT_PASSES = 10;
+
+const double HPGL_UNITS_PER_MM = 40;
+const double GCODE_PEN_UP = 5;   // mm
+
+void plot_stroke_t::reverse() {
+    std::reverse(verbs.begin(), verbs.end());
+
+    // reversing the point pairs also reverses each curve's control points
+    for (size_t ix = 0, jx = points.size() - 2; ix < jx; ix += 2, jx -= 2) {
+        swap(points[ix], points[jx]);
+        swap(points[ix+1], points[jx+1]);
+    }
+}
+
+void plot_stroke_t::append(const plot_stroke_t & next) {
+    verbs.insert(verbs.end(), next.verbs.begin(), next.verbs.end());
+    points.insert(points.end(), next.points.begin() + 2, next.points.end());
+}
+
+// the stroke as a polyline of x,y pairs
+vector<float> plot_stroke_t::flatten() const {
+    vector<float> line(points.begin(), points.begin() + 2);
+
+    const float * p = & points[0];
+    for (uint8_t verb : verbs) {
+        if (verb == DL_LINE_TO) {
+            line.push_back(p[2]);
+            line.push_back(p[3]);
+            p += 2;
+            continue;
+        }
+
+        float length = hypot(p[2]-p[0], p[3]-p[1]) + hypot(p[4]-p[2], p[5]-p[3])
+            + hypot(p[6]-p[4], p[7]-p[5]);
+        int n = min(64, max(1, (int) ceil(length / FLATNESS)));
+        for (int ix = 1; ix <= n; ix += 1) {
+            float t = (float) ix / n;
+            float u = 1 - t;
+            float a = u*u*u, b = 3*u*u*t, c = 3*u*t*t, d = t*t*t;
+            line.push_back(a*p[0] + b*p[2] + c*p[4] + d*p[6]);
+            line.push_back(a*p[1] + b*p[3] + c*p[5] + d*p[7]);
+        }
+        p += 6;
+    }
+
+    return line;
+}
+
+void plot_stats_t::add(const plot_stats_t & other) {
+    draw_length += other.draw_length;
+    travel_length += other.travel_length;
+    lifts += other.lifts;
+}
+
+double plot_stats_t::seconds() const {
+    return draw_length / DRAW_SPEED + travel_length / TRAVEL_SPEED
+        + lifts * PEN_LIFT_TIME;
+}
+
+// Stroked paths and the outlines of dark fills, one stroke per subpath.
+// Images and light fills (knockouts) can't be plotted and are left out.
+vector<plot_stroke_t> collect_strokes(const display_list_t & dl) {
+    vector<plot_stroke_t> strokes;
+
+    for (const dl_op_t & op : dl.ops) {
+        if (op.kind != DL_STROKE && op.kind != DL_FILL) continue;
+        if (op.kind == DL_FILL && op.red + op.green + op.blue > 1.5) continue;
+
+        const float * c = & dl.coords[op.first_coord];
+        plot_stroke_t current;
+        float start_x = 0, start_y = 0;
+
+        auto flush = [&] {
+            if (! current.verbs.empty()) strokes.push_back(current);
+            current = plot_stroke_t();
+        };
+
+        for (uint32_t ix = 0; ix < op.nverbs; ix += 1) {
+            uint8_t verb = dl.verbs[op.first_verb + ix];
+
+            // a line or curve with no current point starts a subpath
+            if (verb == DL_MOVE_TO
+                || (verb != DL_CLOSE_PATH && current.points.empty())) {
+                flush();
+                start_x = c[0];
+                start_y = c[1];
+                current.points = {start_x, start_y};
+                if (verb == DL_MOVE_TO) {
+                    c += 2;
+                    continue;
+                }
+            }
+
+            switch (verb) {
+            case DL_LINE_TO:
+                current.verbs.push_back(DL_LINE_TO);
+                current.points.insert(current.points.end(), c, c+2);
+                c += 2;
+                break;
+            case DL_CURVE_TO:
+                current.verbs.push_back(DL_CURVE_TO);
+                current.points.insert(current.points.end(), c, c+6);
+                c += 6;
+                break;
+            case DL_CLOSE_PATH:
+                if (current.points.empty()) break;
+                if (current.end_x() != start_x || current.end_y() != start_y) {
+                    current.verbs.push_back(DL_LINE_TO);
+                    current.points.push_back(start_x);
+                    current.points.push_back(start_y);
+                }
+                flush();
+                current.points = {start_x, start_y};
+                break;
+            }
+        }
+        flush();
+    }
+
+    return strokes;
+}
+
+uint64_t end_key(float x, float y) {
+    return (uint64_t) (uint32_t) lround(x / TOUCH) << 32
+        | (uint32_t) lround(y / TOUCH);
+}
+
+// joins strokes end to end wherever an end of one touches an end of another
+vector<plot_stroke_t> merge_strokes(const vector<plot_stroke_t> & strokes) {
+    unordered_map<uint64_t, vector<uint32_t>> ends;
+    for (uint32_t ix = 0; ix < strokes.size(); ix += 1) {
+        const plot_stroke_t & s = strokes[ix];
+        ends[end_key(s.start_x(), s.start_y())].push_back(ix);
+        ends[end_key(s.end_x(), s.end_y())].push_back(ix);
+    }
+
+    vector<bool> used(strokes.size(), false);
+    vector<plot_stroke_t> merged;
+
+    for (uint32_t ix = 0; ix < strokes.size(); ix += 1) {
+        if (used[ix]) continue;
+        used[ix] = true;
+        plot_stroke_t chain = strokes[ix];
+
+        // grow the end, then turn around and grow the other end
+        for (int side = 0; side < 2; side += 1) {
+            while (true) {
+                uint64_t key = end_key(chain.end_x(), chain.end_y());
+                auto found = ends.find(key);
+                if (found == ends.end()) break;
+
+                int next = -1;
+                for (uint32_t jx : found->second) {
+                    if (! used[jx]) {
+                        next = jx;
+                        break;
+                    }
+                }
+                if (next < 0) break;
+
+                used[next] = true;
+                plot_stroke_t s = strokes[next];
+                if (end_key(s.start_x(), s.start_y()) != key) s.reverse();
+                chain.append(s);
+            }
+            chain.reverse();
+        }
+
+        merged.push_back(chain);
+    }
+
+    return merged;
+}
+
+struct point_t {
+    float x;
+    float y;
+};
+
+float distance(point_t a, point_t b) {
+    float dx = a.x - b.x;
+    float dy = a.y - b.y;
+    return sqrt(dx*dx + dy*dy);
+}
+
+point_t stop_start(const vector<plot_stroke_t> & strokes, tour_stop_t stop) {
+    const plot_stroke_t & s = strokes[stop.stroke];
+    if (stop.reversed) return {s.end_x(), s.end_y()};
+    return {s.start_x(), s.start_y()};
+}
+
+point_t stop_end(const vector<plot_stroke_t> & strokes, tour_stop_t stop) {
+    const plot_stroke_t & s = strokes[stop.stroke];
+    if (stop.reversed) return {s.start_x(), s.start_y()};
+    return {s.end_x(), s.end_y()};
+}
+
+// A pen-up tour from the page origin through every stroke: nearest
+// neighbour to start, improved by reversing runs of strokes (2-opt).
+vector<tour_stop_t> order_strokes(const vector<plot_stroke_t> & strokes) {
+    size_t n = strokes.size();
+    vector<tour_stop_t> tour;
+    vector<bool> used(n, false);
+
+    point_t pen = {0, 0};
+    for (size_t count = 0; count < n; count += 1) {
+        tour_stop_t best = {0, false};
+        float best_distance = numeric_limits<float>::max();
+        for (uint32_t ix = 0; ix < n; ix += 1) {
+            if (used[ix]) continue;
+            for (bool reversed : {false, true}) {
+                float d = distance(pen, stop_start(strokes, {ix, reversed}));
+                if (d < best_distance) {
+                    best_distance = d;
+                    best = {ix, reversed};
+                }
+            }
+        }
+        used[best.stroke] = true;
+        tour.push_back(best);
+        pen = stop_end(strokes, best);
+    }
+
+    // reversing stops i+1..j swaps the travel a->b, c->d for a->c, b->d,
+    // with a before the first stop being the origin and the tour open ended
+    for (int pass = 0; pass < TWO_OPT_PASSES; pass += 1) {
+        bool improved = false;
+
+        for (int ix = -1; ix + 1 < (int) n; ix += 1) {
+            point_t a = ix < 0 ? point_t{0, 0} : stop_end(strokes, tour[ix]);
+            int last = min<int>(n - 1, ix + TWO_OPT_WINDOW);
+
+            for (int jx = ix + 1; jx <= last; jx += 1) {
+                point_t b = stop_start(strokes, tour[ix+1]);
+                point_t c = stop_end(strokes, tour[jx]);
+                float before = distance(a, b);
+                float after = distance(a, c);
+
+                if (jx + 1 < (int) n) {
+                    point_t d = stop_start(strokes, tour[jx+1]);
+                    before += distance(c, d);
+                    after += distance(b, d);
+                }
+                if (after >= before - TOUCH) continue;
+
+                std::reverse(tour.begin() + ix + 1, tour.begin() + jx + 1);
+                for (int kx = ix + 1; kx <= jx; kx += 1) {
+                    tour[kx].reversed = ! tour[kx].reversed;
+                }
+                improved = true;
+            }
+        }
+
+        if (! improved) break;
+    }
+
+    return tour;
+}
+
+plot_stats_t measure_plot(const vector<plot_stroke_t> & strokes,
+                          const vector<tour_stop_t> & tour) {
+    plot_stats_t stats;
+    point_t pen = {0, 0};
+
+    for (tour_stop_t stop : tour) {
+        stats.travel_length += distance(pen, stop_start(strokes, stop)) * MM_PER_POINT;
+        stats.lifts += 1;
+
+        vector<float> line = strokes[stop.stroke].flatten();
+        for (size_t ix = 2; ix < line.size(); ix += 2) {
+            stats.draw_length += hypot(line[ix] - line[ix-2],
+                                       line[ix+1] - line[ix-1]) * MM_PER_POINT;
+        }
+
+        pen = stop_end(strokes, stop);
+    }
+
+    return stats;
+}
+
+plot_writer_t::plot_writer_t(string filename, plot_language_t newlanguage,
+                             float width, float height) {
+    size_t dot = filename.rfind('.');
+    stem = dot == string::npos ? filename : filename.substr(0, dot);
+    language = newlanguage;
+    paper_width = width * POINTS_PER_INCH;
+    paper_height = height * POINTS_PER_INCH;
+}
+
+void plot_writer_t::add_page(recorded_page_t & page) {
+    vector<plot_stroke_t> strokes = collect_strokes(page.dl);
+
+    vector<tour_stop_t> as_drawn;
+    for (uint32_t ix = 0; ix < strokes.size(); ix += 1) as_drawn.push_back({ix, false});
+    before.add(measure_plot(strokes, as_drawn));
+
+    vector<plot_stroke_t> merged = merge_strokes(strokes);
+    vector<tour_stop_t> tour = order_strokes(merged);
+    after.add(measure_plot(merged, tour));
+
+    write_page(page.page_number, merged, tour);
+}
+
+// plotter y runs up from the bottom of the page
+void plot_writer_t::write_page(int page_number,
+                               const vector<plot_stroke_t> & strokes,
+                               const vector<tour_stop_t> & tour) {
+    string extension = language == HPGL ? ".hpgl" : ".gcode";
+    ofstream out(stem + "-" + to_string(page_number) + extension);
+
+    if (language == HPGL) {
+        auto units = [&](float x, float y) {
+            return to_string(lround(x * MM_PER_POINT * HPGL_UNITS_PER_MM)) + ","
+                + to_string(lround((paper_height - y) * MM_PER_POINT * HPGL_UNITS_PER_MM));
+        };
+
+        out << "IN;SP1;\n";
+        for (tour_stop_t stop : tour) {
+            plot_stroke_t s = strokes[stop.stroke];
+            if (stop.reversed) s.reverse();
+            vector<float> line = s.flatten();
+
+            out << "PU" << units(line[0], line[1]) << ";PD";
+            for (size_t ix = 2; ix < line.size(); ix += 2) {
+                if (ix > 2) out << ",";
+                out << units(line[ix], line[ix+1]);
+            }
+            out << ";\n";
+        }
+        out << "PU;SP0;\n";
+        return;
+    }
+
+    int draw_feed = DRAW_SPEED * 60;   // mm/min
+    out << fixed << setprecision(2);
+    out << "G21\nG90\nG0 Z" << GCODE_PEN_UP << "\n";
+    for (tour_stop_t stop : tour) {
+        plot_stroke_t s = strokes[stop.stroke];
+        if (stop.reversed) s.reverse();
+        vector<float> line = s.flatten();
+
+        out << "G0 X" << line[0] * MM_PER_POINT
+            << " Y" << (paper_height - line[1]) * MM_PER_POINT << "\n";
+        out << "G1 Z0 F" << draw_feed << "\n";
+        for (size_t ix = 2; ix < line.size(); ix += 2) {
+            out << "G1 X" << line[ix] * MM_PER_POINT
+                << " Y" << (paper_height - line[ix+1]) * MM_PER_POINT << "\n";
+        }
+        out << "G0 Z" << GCODE_PEN_UP << "\n";
+    }
+    out << "G0 X0 Y0\nM2\n";
+}
+
+string plot_time(double seconds) {
+    int total = lround(seconds);
+    ostringstream out;
+    out << total / 3600 << ":" << setfill('0') << setw(2) << total / 60 % 60
+        << ":" << setw(2) << total % 60;
+    return out.str();
+}
+
+void plot_writer_t::finish() {
+    for (plot_stats_t * stats : {& before, & after}) {
+        cout << (stats == & before ? "as drawn: " : "optimized: ")
+             << plot_time(stats->seconds()) << " plot time, "
+             << stats->lifts << " pen lifts, " << fixed << setprecision(1)
+             << stats->travel_length / 1000 << " m pen-up travel" << endl;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "display_list.h"
+
+using namespace std;
+
+// Pen plotter output.  Each page's strokes are collected as runs of line
+// and Bézier segments.  Runs whose ends touch are joined, and the runs are
+// ordered to cut pen-up travel (nearest neighbour, then 2-opt).  Each page
+// is written as <stem>-<page>.hpgl or .gcode.
+
+enum plot_language_t {
+    HPGL,
+    GCODE,
+};
+
+struct plot_stroke_t {
+    vector<uint8_t> verbs;   // DL_LINE_TO or DL_CURVE_TO for each segment
+    vector<float> points;    // x,y pairs in points: the start, then 1 or 3 per segment
+
+    float start_x() const { return points[0]; }
+    float start_y() const { return points[1]; }
+    float end_x() const { return points[points.size()-2]; }
+    float end_y() const { return points[points.size()-1]; }
+
+    void reverse();
+    void append(const plot_stroke_t & next);   // next must start at our end
+    vector<float> flatten() const;
+};
+
+// a stroke in plotting order, drawn end to start if reversed
+struct tour_stop_t {
+    uint32_t stroke;
+    bool reversed;
+};
+
+struct plot_stats_t {
+    double draw_length = 0;     // in mm
+    double travel_length = 0;
+    int lifts = 0;
+
+    void add(const plot_stats_t & other);
+    double seconds() const;
+};
+
+struct plot_writer_t : page_sink_t {
+    string stem;
+    plot_language_t language;
+
+    float paper_width;    // in points
+    float paper_height;
+
+    // totals over all pages, as drawn and after merging and ordering
+    plot_stats_t before;
+    plot_stats_t after;
+
+    plot_writer_t(string filename, plot_language_t newlanguage,
+                  float width=5.5, float height=8.5);
+
+    void add_page(recorded_page_t & page);
+    void finish();
+
+    void write_page(int page_number, const vector<plot_stroke_t> & strokes,
+                    const vector<tour_stop_t> & tour);
+};
+
+vector<plot_stroke_t> collect_strokes(const display_list_t & dl);
+vector<plot_stroke_t> merge_strokes(const vector<plot_stroke_t> & strokes);
+vector<tour_stop_t> order_strokes(const vector<plot_stroke_t> & strokes);
+plot_stats_t measure_plot(const vector<plot_stroke_t> & strokes,
+                          const vector<tour_stop_t> & tour);
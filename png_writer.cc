@@ -0,0 +1,150 @@
+#include <cmath>
+#include <iostream>
+
+#include "png_writer.h"
+
+using namespace std;
+
+const float POINTS_PER_INCH = 72.0;
+
+const float THUMBNAIL_DPI = 20;
+const int SHEET_COLUMNS = 12;
+const int SHEET_GAP = 8;   // pixels around each thumbnail
+
+png_writer_t::png_writer_t(string filename, float newdpi, bool newpages,
+                           bool newsheet, int nworkers, float width,
+                           float height) {
+    size_t dot = filename.rfind('.');
+    stem = dot == string::npos ? filename : filename.substr(0, dot);
+    dpi = newdpi;
+    write_pages = newpages;
+    write_contact_sheet = newsheet;
+    paper_width = width * POINTS_PER_INCH;
+    paper_height = height * POINTS_PER_INCH;
+
+    max_queued = 2 * nworkers;
+    for (int ix = 0; ix < nworkers; ix += 1) {
+        workers.push_back(thread([this] { work(); }));
+    }
+}
+
+// without finish, as when a render is abandoned by an exception, the
+// pages still queued are dropped and the workers stopped
+png_writer_t::~png_writer_t() {
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        queue.clear();
+        closing = true;
+        queue_cond.notify_all();
+    }
+    for (thread & worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    for (auto & numbered : thumbnails) cairo_surface_destroy(numbered.second);
+}
+
+void png_writer_t::add_page(recorded_page_t & page) {
+    unique_lock<mutex> lock(queue_mutex);
+    queue_cond.wait(lock, [&] { return queue.size() < max_queued; });
+    queue.push_back(recorded_page_t());
+    swap(queue.back(), page);
+    queue_cond.notify_all();
+}
+
+void png_writer_t::work() {
+    while (true) {
+        recorded_page_t page;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            queue_cond.wait(lock, [&] { return closing || ! queue.empty(); });
+            if (queue.empty()) return;
+            swap(page, queue.front());
+            queue.pop_front();
+            queue_cond.notify_all();
+        }
+
+        if (write_pages) {
+            cairo_surface_t * image = rasterize(page, dpi);
+            string name = stem + "-" + to_string(page.page_number) + ".png";
+            cairo_status_t status = cairo_surface_write_to_png(image, name.c_str());
+            if (status != CAIRO_STATUS_SUCCESS) {
+                cout << "can't write " << name << ": "
+                     << cairo_status_to_string(status) << endl;
+            }
+            cairo_surface_destroy(image);
+        }
+
+        if (write_contact_sheet) {
+            cairo_surface_t * thumbnail = rasterize(page, THUMBNAIL_DPI);
+            lock_guard<mutex> lock(thumbnails_mutex);
+            thumbnails[page.page_number] = thumbnail;
+        }
+    }
+}
+
+// a white page with the display list drawn on it
+cairo_surface_t * png_writer_t::rasterize(const recorded_page_t & page,
+                                          float at_dpi) {
+    float scale = at_dpi / POINTS_PER_INCH;
+    cairo_surface_t * image = cairo_image_surface_create(
+        CAIRO_FORMAT_RGB24, lround(paper_width * scale),
+        lround(paper_height * scale));
+
+    cairo_t * cr = cairo_create(image);
+    cairo_set_source_rgb(cr, 1,1,1);
+    cairo_paint(cr);
+    cairo_scale(cr, scale, scale);
+    page.dl.replay(cr);
+    cairo_destroy(cr);
+
+    return image;
+}
+
+void png_writer_t::finish() {
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        closing = true;
+        queue_cond.notify_all();
+    }
+    for (thread & worker : workers) worker.join();
+    workers.clear();
+
+    if (write_contact_sheet) write_sheet();
+}
+
+// thumbnails in page order, SHEET_COLUMNS to a row
+void png_writer_t::write_sheet() {
+    if (thumbnails.empty()) return;
+
+    int width = cairo_image_surface_get_width(thumbnails.begin()->second);
+    int height = cairo_image_surface_get_height(thumbnails.begin()->second);
+    int ncols = min<int>(SHEET_COLUMNS, thumbnails.size());
+    int nrows = (thumbnails.size() + SHEET_COLUMNS - 1) / SHEET_COLUMNS;
+
+    cairo_surface_t * sheet = cairo_image_surface_create(
+        CAIRO_FORMAT_RGB24, ncols * (width + SHEET_GAP) + SHEET_GAP,
+        nrows * (height + SHEET_GAP) + SHEET_GAP);
+    cairo_t * cr = cairo_create(sheet);
+    cairo_set_source_rgb(cr, 0.5,0.5,0.5);
+    cairo_paint(cr);
+
+    int ix = 0;
+    for (auto & numbered : thumbnails) {
+        int x = SHEET_GAP + ix % SHEET_COLUMNS * (width + SHEET_GAP);
+        int y = SHEET_GAP + ix / SHEET_COLUMNS * (height + SHEET_GAP);
+        cairo_set_source_surface(cr, numbered.second, x, y);
+        cairo_paint(cr);
+        cairo_surface_destroy(numbered.second);
+        ix += 1;
+    }
+    thumbnails.clear();
+    cairo_destroy(cr);
+
+    string name = stem + "-contact.png";
+    cairo_status_t status = cairo_surface_write_to_png(sheet, name.c_str());
+    if (status != CAIRO_STATUS_SUCCESS) {
+        cout << "can't write " << name << ": " << cairo_status_to_string(status)
+             << endl;
+    }
+    cairo_surface_destroy(sheet);
+}
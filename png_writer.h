@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <cairo.h>
+}
+
+#include "display_list.h"
+
+using namespace std;
+
+// Rasterizes recorded pages to png on a pool of worker threads, each with
+// its own image surface, as the pages arrive.  Writes <stem>-<page>.png
+// at dpi, and/or a contact sheet of thumbnails of every page.
+
+struct png_writer_t : page_sink_t {
+    string stem;
+    float dpi;
+    bool write_pages;
+    bool write_contact_sheet;
+
+    float paper_width;    // in points
+    float paper_height;
+
+    mutex queue_mutex;
+    condition_variable queue_cond;
+    deque<recorded_page_t> queue;
+    size_t max_queued;   // pages waiting, beyond which add_page blocks
+    bool closing = false;
+    vector<thread> workers;
+
+    mutex thumbnails_mutex;
+    map<int, cairo_surface_t *> thumbnails;   // by page number
+
+    png_writer_t(string filename, float newdpi, bool newpages, bool newsheet,
+                 int nworkers, float width=5.5, float height=8.5);
+    ~png_writer_t();
+
+    void add_page(recorded_page_t & page);
+    void finish();
+
+    void work();
+    cairo_surface_t * rasterize(const recorded_page_t & page, float at_dpi);
+    void write_sheet();
+};
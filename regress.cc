@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "skullbat.h"
+#include "stats.h"
+
+using namespace std;
+
+// Golden-output regression check.  Renders a book, rasterizes every page
+// onto a cairo image surface at a fixed dpi and hashes the pixels, then
+// compares the hashes with <book>.golden, so a change that moves any
+// glyph by a pixel is caught.  Each run's wall time and peak memory are
+// appended to regress.history, and flagged when they are more than
+// SLOWER_BY over the best of the last HISTORY_WINDOW runs.
+//
+// The hashes depend on the cairo build, so the golden file is made on the
+// machine that checks against it: the first run (or --update) writes it.
+
+const char * HISTORY_FILE = "regress.history";
+const size_t HISTORY_WINDOW = 5;
+const double SLOWER_BY = 1.10;
+
+const float REGRESS_DPI = 100;
+
+// hashes each page's pixels as it arrives
+struct hash_sink_t : page_sink_t {
+    float dpi;
+    float paper_width;    // in points
+    float paper_height;
+    map<int, uint64_t> hashes;   // by page number
+
+    hash_sink_t(float newdpi, float width=5.5, float height=8.5)
+        : dpi(newdpi), paper_width(width * POINTS_PER_INCH),
+          paper_height(height * POINTS_PER_INCH) {
+    }
+
+    void add_page(recorded_page_t & page) {
+        float scale = dpi / POINTS_PER_INCH;
+        cairo_surface_t * image = cairo_image_surface_create(
+            CAIRO_FORMAT_RGB24, lround(paper_width * scale),
+            lround(paper_height * scale));
+
+        cairo_t * cr = cairo_create(image);
+        cairo_set_source_rgb(cr, 1,1,1);
+        cairo_paint(cr);
+        cairo_scale(cr, scale, scale);
+        page.dl.replay(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(image);
+
+        // rows only, the padding at the end of each is undefined
+        int width = cairo_image_surface_get_width(image);
+        int height = cairo_image_surface_get_height(image);
+        int stride = cairo_image_surface_get_stride(image);
+        unsigned char * data = cairo_image_surface_get_data(image);
+        uint64_t hash = FNV_OFFSET;
+        for (int y = 0; y < height; y += 1) {
+            hash = hash_bytes(data + y * stride, width * 4, hash);
+        }
+        hashes[page.page_number] = hash;
+
+        cairo_surface_destroy(image);
+    }
+};
+
+map<int, uint64_t> read_golden(string filename) {
+    map<int, uint64_t> hashes;
+    ifstream in(filename);
+    int page;
+    string hash;
+    while (in >> page >> hash) hashes[page] = stoull(hash, nullptr, 16);
+    return hashes;
+}
+
+void write_golden(string filename, const map<int, uint64_t> & hashes) {
+    ofstream out(filename);
+    for (auto & entry : hashes) {
+        out << entry.first << " " << hex << setw(16) << setfill('0')
+            << entry.second << dec << setfill(' ') << "\n";
+    }
+    if (! out) die("can't write " + filename);
+}
+
+struct history_entry_t {
+    string when;
+    string label;
+    string book;
+    double seconds;
+    long rss;
+};
+
+// tab separated: date, label, book, pages, seconds, peak KB, result
+vector<history_entry_t> read_history(string book) {
+    vector<history_entry_t> entries;
+    ifstream in(HISTORY_FILE);
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        history_entry_t entry;
+        string pages, seconds, rss;
+        getline(fields, entry.when, '\t');
+        getline(fields, entry.label, '\t');
+        getline(fields, entry.book, '\t');
+        getline(fields, pages, '\t');
+        getline(fields, seconds, '\t');
+        getline(fields, rss, '\t');
+        if (entry.book != book || seconds.empty() || rss.empty()) continue;
+        entry.seconds = atof(seconds.c_str());
+        entry.rss = atol(rss.c_str());
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+int main(int nargs, char * args[])
+{
+    string filename;
+    string label = "-";
+    bool update = false;
+    float dpi = REGRESS_DPI;
+
+    for (int ix = 1; ix < nargs; ix += 1) {
+        string arg = args[ix];
+        if (arg == "--update") update = true;
+        else if (arg.substr(0,8) == "--label=") label = arg.substr(8);
+        else if (arg.substr(0,6) == "--dpi=") {
+            dpi = atof(arg.substr(6).c_str());
+            if (dpi <= 0) die("bad dpi: " + arg.substr(6));
+        }
+        else if (arg[0] == '-') die("unknown option: " + arg);
+        else if (filename.empty()) filename = arg;
+        else die("filename");
+    }
+    if (filename.empty()) die("filename");
+    if (! ifstream(filename)) die("can't read " + filename);
+
+    auto start = chrono::steady_clock::now();
+
+    // unknown words are part of the output, not of the report
+    streambuf * saved = cout.rdbuf(nullptr);
+    load_phonetic();
+    hash_sink_t sink(dpi);
+    {
+        target_t tgt(RECORD_TARGET, & sink);
+        tgt.new_page();
+        {
+            typesetter_t ts(tgt);
+            para_reader_t reader(filename);
+            para_t para;
+            while (reader.next(para)) ts.typeset(para);
+        }
+        tgt.save_and_close();
+    }
+    cout.rdbuf(saved);
+    cout.clear();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long rss = peak_rss();
+
+    // pages
+    string golden_filename = filename + ".golden";
+    map<int, uint64_t> golden = read_golden(golden_filename);
+    string result = "ok";
+    if (update || golden.empty()) {
+        write_golden(golden_filename, sink.hashes);
+        cout << "wrote " << sink.hashes.size() << " page hashes to " << golden_filename << endl;
+        result = "golden";
+    }
+    else {
+        vector<int> changed;
+        for (auto & entry : sink.hashes) {
+            auto it = golden.find(entry.first);
+            if (it == golden.end() || it->second != entry.second) changed.push_back(entry.first);
+        }
+        for (auto & entry : golden) {
+            if (! sink.hashes.count(entry.first)) changed.push_back(entry.first);
+        }
+        sort(changed.begin(), changed.end());
+
+        if (! changed.empty()) {
+            result = "changed";
+            cout << changed.size() << " of " << golden.size() << " pages changed:";
+            for (int page : changed) cout << " " << page;
+            cout << endl;
+        }
+        else cout << "all " << golden.size() << " pages match" << endl;
+    }
+
+    // performance, against the best of the recent runs of this book
+    vector<history_entry_t> history = read_history(filename);
+    if (history.size() > HISTORY_WINDOW) {
+        history.erase(history.begin(), history.end() - HISTORY_WINDOW);
+    }
+
+    cout << fixed << setprecision(2) << seconds << " s, peak " << rss / 1024 << " MB";
+    if (! history.empty()) {
+        double best_seconds = history[0].seconds;
+        long best_rss = history[0].rss;
+        for (history_entry_t & entry : history) {
+            best_seconds = min(best_seconds, entry.seconds);
+            best_rss = min(best_rss, entry.rss);
+        }
+        cout << " (best of last " << history.size() << ": " << best_seconds << " s, "
+             << best_rss / 1024 << " MB)";
+
+        if (seconds > best_seconds * SLOWER_BY) {
+            cout << "\nslower by " << setprecision(0) << (seconds / best_seconds - 1) * 100 << "%";
+            if (result == "ok") result = "slower";
+        }
+        if (rss > best_rss * SLOWER_BY) {
+            cout << "\nmore memory by " << setprecision(0) << (double(rss) / best_rss - 1) * 100 << "%";
+            if (result == "ok") result = "bigger";
+        }
+    }
+    cout << endl;
+
+    time_t now = time(nullptr);
+    char when[32];
+    strftime(when, sizeof when, "%Y-%m-%d %H:%M:%S", localtime(& now));
+
+    ofstream history_out(HISTORY_FILE, ios::app);
+    history_out << fixed << when << "\t" << label << "\t" << filename << "\t"
+                << sink.hashes.size() << "\t" << setprecision(3) << seconds << "\t"
+                << rss << "\t" << result << "\n";
+
+    return result == "changed" ? 1 : 0;
+}
@@ -0,0 +1,2742 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "pdf_writer.h"
+#include "plot_writer.h"
+#include "png_writer.h"
+#include "skullbat.h"
+#include "stats.h"
+#include "svg_writer.h"
+#include "trace.h"
+
+using namespace std;
+
+void die(string message) {
+    cout << message << endl;
+    exit(1);
+}
+
+float nan() {
+    // presence is not checked explicitly, exception thrown if use is attempted
+    return numeric_limits<float>::signaling_NaN();
+}
+
+output_format_t output_format = CAIRO_PDF_OUTPUT;
+float png_dpi = 100;
+bool png_pages = false;
+bool png_contact_sheet = false;
+
+bool fast_pdf = false;
+
+bool operator==(const context_state_t & a, const context_state_t & b) {
+    return a.cur_row == b.cur_row && a.cur_col == b.cur_col
+        && a.need_fresh_column == b.need_fresh_column
+        && a.emphasis == b.emphasis;
+}
+
+target_t::target_t(string filename, float newwidth, float newheight,
+                   float newmargin) {
+    kind = PDF_TARGET;
+
+    // the other writers only take recorded pages
+    if (output_format != CAIRO_PDF_OUTPUT) {
+        kind = RECORD_TARGET;
+        owned_sink.reset(open_sink(filename, newwidth, newheight));
+        sink = owned_sink.get();
+        csurf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,
+                                               nullptr);
+    }
+    else {
+        csurf = cairo_pdf_surface_create(
+            filename.c_str(),
+            newwidth * POINTS_PER_INCH,
+            newheight * POINTS_PER_INCH);
+    }
+
+    init(newwidth, newheight, newmargin);
+}
+
+target_t::target_t(target_kind_t newkind, page_sink_t * newsink,
+                   float newwidth, float newheight, float newmargin) {
+    kind = newkind;
+    sink = newsink;
+
+    // paths are only built on the scratch surface, never drawn to it
+    if (kind == RECORD_TARGET) {
+        csurf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,
+                                               nullptr);
+    }
+    else csurf = nullptr;
+
+    init(newwidth, newheight, newmargin);
+}
+
+target_t::target_t(cairo_surface_t * surface, float newwidth,
+                   float newheight, float newmargin) {
+    kind = PDF_TARGET;
+    csurf = surface;
+
+    init(newwidth, newheight, newmargin);
+}
+
+target_t::~target_t() {
+    delete pn;
+}
+
+void target_t::init(float newwidth, float newheight, float newmargin) {
+    paper_width = newwidth;
+    paper_height = newheight;
+    margin = newmargin;
+
+    // only svg reuses glyph shapes
+    mark_glyphs = kind == RECORD_TARGET
+        && (output_format == SVG_OUTPUT || output_format == HTML_OUTPUT);
+
+    pn = new skullbat_context_t(* this);
+    if (pn->cr) pn->build_digit_paths();
+}
+
+void target_t::new_page_subscribe(sbj_t * sbj) {
+    sbj_contexts.insert(sbj);
+}
+
+void target_t::new_page_unsubscribe(sbj_t * sbj) {
+    sbj_contexts.erase(sbj);
+}
+
+void target_t::new_page() {
+    STAGE_TIMER(STAGE_NEW_PAGE);
+    TRACE_SPAN("new_page", page_number + 1);
+
+    if (page_open) finish_page();
+
+    page_number += 1;
+    page_open = true;
+
+    drawing = kind != MEASURE_TARGET
+        && first_drawn <= page_number && page_number <= last_drawn;
+
+    // a partial pdf keeps the book's page numbers
+    if (drawing && kind == PDF_TARGET && first_drawn > 1) {
+        cairo_pdf_surface_set_page_label(csurf, to_string(page_number).c_str());
+    }
+
+    mark_page_number();
+
+    for (sbj_t * sbj : sbj_contexts) sbj->handle_new_page();
+}
+
+void target_t::finish_page() {
+    if (drawing) COUNT_PAGES(1);
+
+    if (drawing && kind == PDF_TARGET) cairo_surface_show_page(csurf);
+    else if (drawing && kind == RECORD_TARGET) {
+        recorded_page_t page;
+        page.page_number = page_number;
+        swap(page.dl, dl);
+        sink->add_page(page);
+    }
+
+    page_open = false;
+}
+
+// drops a partly drawn page
+void target_t::discard_page() {
+    dl.clear();
+    page_open = false;
+}
+
+bool even(int n) {
+    return n % 2 == 0;
+}
+
+void target_t::mark_page_number() {
+    if (! drawing || ! number_pages) return;
+
+    float x = even(page_number) ? margin/2 : paper_width - margin/2;
+    float y = margin/2;
+    pn->render_number_at_inches(page_number, x, y);
+}
+
+void target_t::stroke(cairo_t * cr) {
+    if (kind == RECORD_TARGET) {
+        dl.add_path(DL_STROKE, cr);
+        cairo_new_path(cr);
+    }
+    else cairo_stroke(cr);
+}
+
+void target_t::fill(cairo_t * cr) {
+    if (kind == RECORD_TARGET) {
+        dl.add_path(DL_FILL, cr);
+        cairo_new_path(cr);
+    }
+    else cairo_fill(cr);
+}
+
+// the image must already be set as the source of cr
+void target_t::paint_image(cairo_t * cr, string name) {
+    if (kind == RECORD_TARGET) dl.add_image(name, cr);
+    else cairo_paint(cr);
+}
+
+// at cr's current point; recorded pages keep the text's outline, marked
+// with the text for the replays that can show it
+void target_t::show_text(cairo_t * cr, string text) {
+    if (kind == RECORD_TARGET) {
+        dl.begin_text(text, cr);
+        cairo_text_path(cr, text.c_str());
+        fill(cr);
+        dl.end_text();
+    }
+    else cairo_show_text(cr, text.c_str());
+}
+
+// x, y is the glyph's origin in the user space of cr
+void target_t::begin_glyph(cairo_t * cr, string key, float x, float y) {
+    if (mark_glyphs && drawing) dl.begin_glyph(key, cr, x, y);
+}
+
+void target_t::end_glyph() {
+    if (mark_glyphs && drawing) dl.end_glyph();
+}
+
+// the fragment's device space is the page's
+void target_t::draw_fragment(const display_list_t & fragment) {
+    if (! drawing) return;
+
+    if (kind == RECORD_TARGET) dl.append(fragment);
+    else {
+        cairo_t * cr = cairo_create(csurf);
+        fragment.replay(cr, true);
+        cairo_destroy(cr);
+    }
+}
+
+void target_t::save_and_close() {
+    STAGE_TIMER(STAGE_SAVE_AND_CLOSE);
+    TRACE_SPAN("save_and_close");
+
+    if (page_open) finish_page();
+
+    if (csurf) {
+        cairo_surface_finish(csurf);
+        cairo_surface_destroy(csurf);
+        csurf = nullptr;
+    }
+
+    if (sink) sink->finish();
+}
+
+void display_list_t::clear() {
+    ops.clear();
+    verbs.clear();
+    coords.clear();
+    names.clear();
+}
+
+// captures the current path of cr, with the stroke/fill state that applies
+void display_list_t::add_path(dl_kind_t kind, cairo_t * cr) {
+    dl_op_t op;
+    op.kind = kind;
+    op.line_cap = cairo_get_line_cap(cr);
+    op.line_join = cairo_get_line_join(cr);
+
+    // sources are always solid colours in this program
+    double red, green, blue, alpha;
+    cairo_pattern_get_rgba(cairo_get_source(cr), & red, & green, & blue,
+                           & alpha);
+    op.red = red;
+    op.green = green;
+    op.blue = blue;
+
+    double dx = cairo_get_line_width(cr);
+    double dy = 0;
+    cairo_user_to_device_distance(cr, & dx, & dy);
+    op.line_width = hypot(dx, dy);
+
+    op.first_verb = verbs.size();
+    op.first_coord = coords.size();
+    op.name = 0;
+
+    // with an identity matrix the path comes back in device space
+    cairo_save(cr);
+    cairo_identity_matrix(cr);
+    cairo_path_t * path = cairo_copy_path(cr);
+    cairo_restore(cr);
+
+    for (int ix = 0; ix < path->num_data; ix += path->data[ix].header.length) {
+        cairo_path_data_t * data = & path->data[ix];
+        switch (data->header.type) {
+        case CAIRO_PATH_MOVE_TO:
+            verbs.push_back(DL_MOVE_TO);
+            break;
+        case CAIRO_PATH_LINE_TO:
+            verbs.push_back(DL_LINE_TO);
+            break;
+        case CAIRO_PATH_CURVE_TO:
+            verbs.push_back(DL_CURVE_TO);
+            break;
+        case CAIRO_PATH_CLOSE_PATH:
+            verbs.push_back(DL_CLOSE_PATH);
+            break;
+        }
+        for (int jx = 1; jx < data->header.length; jx += 1) {
+            coords.push_back(data[jx].point.x);
+            coords.push_back(data[jx].point.y);
+        }
+    }
+    cairo_path_destroy(path);
+
+    op.nverbs = verbs.size() - op.first_verb;
+    ops.push_back(op);
+}
+
+void display_list_t::add_image(string name, cairo_t * cr) {
+    dl_op_t op = {};
+    op.kind = DL_IMAGE;
+    op.first_coord = coords.size();
+    op.name = names.size();
+    names.push_back(name);
+
+    cairo_matrix_t m;
+    cairo_get_matrix(cr, & m);
+    for (double v : {m.xx, m.yx, m.xy, m.yy, m.x0, m.y0}) coords.push_back(v);
+
+    ops.push_back(op);
+}
+
+void display_list_t::begin_glyph(string key, cairo_t * cr, double x, double y) {
+    dl_op_t op = {};
+    op.kind = DL_BEGIN_GLYPH;
+    op.first_coord = coords.size();
+    op.name = names.size();
+    names.push_back(key);
+
+    cairo_user_to_device(cr, & x, & y);
+    coords.push_back(x);
+    coords.push_back(y);
+
+    ops.push_back(op);
+}
+
+void display_list_t::end_glyph() {
+    dl_op_t op = {};
+    op.kind = DL_END_GLYPH;
+    ops.push_back(op);
+}
+
+// at cr's current point, in its current font and source
+void display_list_t::begin_text(string text, cairo_t * cr) {
+    dl_op_t op = {};
+    op.kind = DL_BEGIN_TEXT;
+
+    cairo_font_face_t * face = cairo_get_font_face(cr);
+    op.line_cap = cairo_toy_font_face_get_slant(face);
+    op.line_join = cairo_toy_font_face_get_weight(face);
+
+    double red, green, blue, alpha;
+    cairo_pattern_get_rgba(cairo_get_source(cr), & red, & green, & blue,
+                           & alpha);
+    op.red = red;
+    op.green = green;
+    op.blue = blue;
+
+    op.first_coord = coords.size();
+    op.name = names.size();
+    names.push_back(text);
+    names.push_back(cairo_toy_font_face_get_family(face));
+
+    double x, y;
+    cairo_get_current_point(cr, & x, & y);
+    cairo_user_to_device(cr, & x, & y);
+    coords.push_back(x);
+    coords.push_back(y);
+
+    // the font matrix in device space
+    cairo_matrix_t font, ctm;
+    cairo_get_font_matrix(cr, & font);
+    cairo_get_matrix(cr, & ctm);
+    cairo_matrix_multiply(& font, & font, & ctm);
+    for (double v : {font.xx, font.yx, font.xy, font.yy}) coords.push_back(v);
+
+    ops.push_back(op);
+}
+
+void display_list_t::end_text() {
+    dl_op_t op = {};
+    op.kind = DL_END_TEXT;
+    ops.push_back(op);
+}
+
+void display_list_t::append(const display_list_t & other) {
+    uint32_t verb_base = verbs.size();
+    uint32_t coord_base = coords.size();
+    uint32_t name_base = names.size();
+
+    for (dl_op_t op : other.ops) {
+        op.first_verb += verb_base;
+        op.first_coord += coord_base;
+        if (op.kind == DL_IMAGE || op.kind == DL_BEGIN_GLYPH
+            || op.kind == DL_BEGIN_TEXT) {
+            op.name += name_base;
+        }
+        ops.push_back(op);
+    }
+    verbs.insert(verbs.end(), other.verbs.begin(), other.verbs.end());
+    coords.insert(coords.end(), other.coords.begin(), other.coords.end());
+    names.insert(names.end(), other.names.begin(), other.names.end());
+}
+
+void write_display_list(ostream & out, const display_list_t & dl) {
+    write_pods(out, dl.ops);
+    write_pods(out, dl.verbs);
+    write_pods(out, dl.coords);
+    write_pod(out, (uint64_t) dl.names.size());
+    for (const string & name : dl.names) {
+        write_pod(out, (uint64_t) name.size());
+        out.write(name.data(), name.size());
+    }
+}
+
+bool read_display_list(istream & in, display_list_t & dl) {
+    if (! read_pods(in, dl.ops)) return false;
+    if (! read_pods(in, dl.verbs)) return false;
+    if (! read_pods(in, dl.coords)) return false;
+
+    uint64_t n;
+    if (! read_pod(in, n)) return false;
+    if (n > bytes_left(in) / sizeof (uint64_t)) return false;
+    dl.names.resize(n);
+    for (string & name : dl.names) {
+        uint64_t size;
+        if (! read_pod(in, size)) return false;
+        if (size > bytes_left(in)) return false;
+        name.resize(size);
+        if (! in.read(& name[0], size)) return false;
+    }
+    return dl.valid();
+}
+
+bool display_list_t::valid() const {
+    for (const dl_op_t & op : ops) {
+        if (op.first_coord > coords.size()) return false;
+        size_t ncoords = coords.size() - op.first_coord;
+
+        switch (op.kind) {
+        case DL_STROKE:
+        case DL_FILL: {
+            if (op.first_verb > verbs.size() || op.nverbs > verbs.size() - op.first_verb) return false;
+            size_t needed = 0;
+            for (uint32_t ix = 0; ix < op.nverbs; ix += 1) {
+                switch (verbs[op.first_verb + ix]) {
+                case DL_MOVE_TO:
+                case DL_LINE_TO:
+                    needed += 2;
+                    break;
+                case DL_CURVE_TO:
+                    needed += 6;
+                    break;
+                case DL_CLOSE_PATH:
+                    break;
+                default:
+                    return false;
+                }
+            }
+            if (needed > ncoords) return false;
+            break;
+        }
+        case DL_IMAGE:
+            if (ncoords < 6 || op.name >= names.size()) return false;
+            break;
+        case DL_BEGIN_GLYPH:
+            if (ncoords < 2 || op.name >= names.size()) return false;
+            break;
+        case DL_BEGIN_TEXT:
+            if (ncoords < 6 || op.name + 1 >= names.size()) return false;
+            break;
+        case DL_END_GLYPH:
+        case DL_END_TEXT:
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t hash_bytes(const void * bytes, size_t n, uint64_t hash) {
+    const unsigned char * p = (const unsigned char *) bytes;
+    for (size_t ix = 0; ix < n; ix += 1) {
+        hash ^= p[ix];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hash_bytes(const string & bytes, uint64_t hash) {
+    return hash_bytes(bytes.data(), bytes.size(), hash);
+}
+
+// Each png is decoded once per thread and the surface shared by everything
+// that thread draws, so cairo embeds one copy of an image however often a
+// pdf uses it (a pdf is always drawn on one thread).  Cairo surfaces can't
+// be used from two threads at once, so the png writer's workers and the
+// --batch threads decode their own, and drop them when the thread exits.
+struct image_cache_t {
+    map<string, cairo_surface_t *> images;
+
+    ~image_cache_t();
+};
+
+image_cache_t::~image_cache_t() {
+    for (auto & entry : images) cairo_surface_destroy(entry.second);
+}
+
+thread_local image_cache_t image_cache;
+
+cairo_surface_t * cached_image(string name) {
+    cairo_surface_t * & image = image_cache.images[name];
+    if (! image) image = cairo_image_surface_create_from_png(name.c_str());
+    return image;
+}
+
+// draws onto cr, whose user space must be in points; show_text draws text
+// as text rather than its outline, which looks up its font
+void display_list_t::replay(cairo_t * cr, bool show_text) const {
+    bool in_text = false;
+    for (const dl_op_t & op : ops) {
+        const float * c = & coords[op.first_coord];
+
+        if (op.kind == DL_BEGIN_TEXT && show_text) {
+            cairo_matrix_t font = {c[2], c[3], c[4], c[5], 0, 0};
+            cairo_save(cr);
+            cairo_select_font_face(cr, names[op.name + 1].c_str(),
+                                   (cairo_font_slant_t) op.line_cap,
+                                   (cairo_font_weight_t) op.line_join);
+            cairo_set_font_matrix(cr, & font);
+            cairo_set_source_rgb(cr, op.red, op.green, op.blue);
+            cairo_move_to(cr, c[0], c[1]);
+            cairo_show_text(cr, names[op.name].c_str());
+            cairo_restore(cr);
+            in_text = true;
+            continue;
+        }
+        if (op.kind == DL_END_TEXT) in_text = false;
+        if (in_text) continue;
+
+        if (op.kind == DL_IMAGE) {
+            cairo_matrix_t m = {c[0], c[1], c[2], c[3], c[4], c[5]};
+            cairo_save(cr);
+            cairo_transform(cr, & m);
+            cairo_set_source_surface(cr, cached_image(names[op.name]), 0,0);
+            cairo_paint(cr);
+            cairo_restore(cr);
+            continue;
+        }
+        if (op.kind == DL_BEGIN_GLYPH || op.kind == DL_END_GLYPH
+            || op.kind == DL_BEGIN_TEXT || op.kind == DL_END_TEXT) {
+            continue;
+        }
+
+        cairo_new_path(cr);
+        for (uint32_t ix = 0; ix < op.nverbs; ix += 1) {
+            switch (verbs[op.first_verb + ix]) {
+            case DL_MOVE_TO:
+                cairo_move_to(cr, c[0], c[1]);
+                c += 2;
+                break;
+            case DL_LINE_TO:
+                cairo_line_to(cr, c[0], c[1]);
+                c += 2;
+                break;
+            case DL_CURVE_TO:
+                cairo_curve_to(cr, c[0], c[1], c[2], c[3], c[4], c[5]);
+                c += 6;
+                break;
+            case DL_CLOSE_PATH:
+                cairo_close_path(cr);
+                break;
+            }
+        }
+
+        cairo_set_source_rgb(cr, op.red, op.green, op.blue);
+        if (op.kind == DL_STROKE) {
+            cairo_set_line_width(cr, op.line_width);
+            cairo_set_line_cap(cr, (cairo_line_cap_t) op.line_cap);
+            cairo_set_line_join(cr, (cairo_line_join_t) op.line_join);
+            cairo_stroke(cr);
+        }
+        else cairo_fill(cr);
+    }
+}
+
+void sb_t::set_skullbat_scale(float newscale) {
+    scale = newscale;
+
+    if (cr) cairo_set_line_width(cr, scale*line_weight);
+
+    unit = scale/5.0;
+    word_width = unit;
+
+    step = unit/4;
+    halfstep = step/2;
+    ribstep = 2*step/3;
+    vowelstep = ribstep;
+    wordstep = step;
+
+    elstep = step * el_rise;
+    eldx = step * el_halfwidth;
+
+    hookrad = 2*halfstep/3;
+    dotrad = 2*halfstep/5;
+    voicedlen = 2*step/3;
+
+    vowel_size = halfstep + 2*dotrad;
+}
+
+void sbj_t::set_column_scale(float newscale) {
+    float row_width = target.paper_width - target.margin*2;
+
+    ncols = row_width / (word_width * COLUMN_SPACING);
+    colstep = row_width / ncols;
+}
+
+void sbj_t::set_row_count(int newrows) {
+    rows_per_page = newrows;
+    inner_row_height = (target.paper_height - target.margin) / rows_per_page;
+    column_height = inner_row_height - target.margin;
+}
+
+//TODO unify setting x and y skullbat rendering positions
+void sbj_t::set_column(int newcol) {
+    cur_col = newcol;
+
+    spinex = target.margin + word_width/2 + (cur_col-1)*colstep;
+    leftx = spinex - step;
+    rightx = spinex + step;
+    markx = rightx + halfstep;
+
+    starty = target.margin + inner_row_height * (cur_row-1);
+    riby = starty;
+
+    need_fresh_column = false;
+}
+
+void sbj_t::next_column() {
+    if (cur_col + 1 > ncols) next_row();
+    else set_column(cur_col + 1);
+}
+
+void sbj_t::render_row_separator(int row) {
+    if (! target.drawing) return;
+
+    float sepy = target.margin/2 + inner_row_height * (row-1);
+    cairo_move_to(scr, target.margin, sepy);
+    cairo_line_to(scr, target.paper_width - target.margin, sepy);
+    target.stroke(scr);
+}
+
+void sbj_t::first_row() {
+    cur_row = 1;
+    set_column(1);
+}
+
+void sbj_t::next_row() {
+    cur_row += 1;
+
+    if (cur_row > rows_per_page) {
+        target.new_page();
+        first_row();
+    }
+    else {
+        render_row_separator(cur_row);
+        set_column(1);
+    }
+}
+
+void sbj_t::handle_new_page() {
+    first_row();
+}
+
+context_state_t sbj_t::save_state() {
+    return {cur_row, cur_col, need_fresh_column, emphasis};
+}
+
+void sbj_t::restore_state(const context_state_t & state) {
+    cur_row = state.cur_row;
+    set_column(state.cur_col);
+    need_fresh_column = state.need_fresh_column;
+    emphasis = state.emphasis;
+}
+
+void sb_t::render_voice_mark(float offset=0.0) {
+    cairo_move_to(cr, markx, riby - voicedlen/2 + offset);
+    cairo_line_to(cr, markx, riby + voicedlen/2 + offset);
+}
+
+float sb_t::size_consonant(char c) {
+    float size = 0;
+
+    switch (c) {
+    case 'b':
+    case 'p':
+        break;
+    case 'v':
+    case 'f':
+        size += halfstep;
+        break;
+    case 'D':
+    case 'T':
+        size += halfstep;
+        break;
+    case 'd':
+    case 't':
+        break;
+    case 'j':
+    case 'c':
+        size += ribstep/2;
+        size += halfstep;
+        break;
+    case 'z':
+    case 's':
+        size += halfstep;
+        break;
+    case 'Z':
+    case 'S':
+        size += halfstep;
+        break;
+    case 'g':
+    case 'k':
+        break;
+    case 'h':
+        size += halfstep;
+        break;
+    case 'w':
+        size += halfstep;
+        break;
+    case 'l':
+    case 'r':
+        size += elstep;
+        break;
+    case 'y':
+        size += halfstep;
+        break;
+    case 'm':
+    case 'n':
+    case 'N':
+        size += 3*step/4;
+        break;
+    default:
+        // unimplemented letter
+        size += step;
+        break;
+    }
+
+    return size;
+}
+
+struct point_t {
+    float x;
+    float y;
+};
+
+point_t r_rotate(point_t p0) {
+    point_t p;
+    float u = 1.0/sqrt(5);
+    p.x = p0.x * -2*u + p0.y * -u;
+    p.y = p0.x * u + p0.y * -2*u;
+    return p;
+}
+
+void sb_t::render_consonant(char c) {
+    switch (c) {
+    case 'b':
+        render_voice_mark();
+    case 'p':
+        cairo_move_to(cr, spinex, riby);
+        cairo_line_to(cr, rightx, riby);
+        break;
+    case 'v':
+        render_voice_mark(halfstep/2);
+    case 'f':
+        cairo_move_to(cr, spinex, riby);
+        /*
+        cairo_line_to(cr, rightx, riby);
+        cairo_rel_line_to(cr, -halfstep/2, halfstep);
+        */
+        cairo_rel_line_to(cr, 3*step/6, 0);
+        cairo_rel_curve_to(cr, 2*step/3,0, 2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        break;
+    case 'D':
+        render_voice_mark(halfstep/2);
+    case 'T':
+        cairo_move_to(cr, spinex, riby);
+        cairo_line_to(cr, rightx, riby);
+        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        break;
+    case 'd':
+        render_voice_mark();
+    case 't':
+        cairo_move_to(cr, leftx, riby);
+        cairo_line_to(cr, rightx, riby);
+        break;
+    case 'j':
+        render_voice_mark(halfstep/2+ribstep/4);
+    case 'c':
+        cairo_move_to(cr, rightx, riby);
+        cairo_line_to(cr, leftx, riby);
+        riby += ribstep/2;
+        cairo_move_to(cr, leftx, riby);
+        cairo_line_to(cr, rightx, riby);
+        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        break;
+    case 'z':
+        render_voice_mark(halfstep/2);
+    case 's':
+        cairo_move_to(cr, leftx, riby);
+        /*
+        cairo_line_to(cr, rightx, riby);
+        cairo_rel_line_to(cr, -halfstep/2, halfstep);
+        */
+        cairo_rel_line_to(cr, 9*step/6, 0);
+        cairo_rel_curve_to(cr, 2*step/3,0, 2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        break;
+    case 'Z':
+        render_voice_mark(halfstep/2);
+    case 'S':
+        cairo_move_to(cr, leftx, riby);
+        cairo_line_to(cr, rightx, riby);
+        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        break;
+    case 'g':
+        render_voice_mark();
+    case 'k':
+        cairo_move_to(cr, leftx, riby);
+        cairo_line_to(cr, spinex, riby);
+        break;
+    case 'h':
+        cairo_move_to(cr, leftx, riby);
+        cairo_line_to(cr, spinex, riby);
+        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        break;
+    case 'w':
+        cairo_move_to(cr, rightx, riby);
+        riby += halfstep;
+        cairo_line_to(cr, spinex, riby);
+        break;
+    case 'l':
+        cairo_move_to(cr, spinex+eldx, riby);
+        riby += elstep;
+        cairo_line_to(cr, spinex-eldx, riby);
+        break;
+    case 'r':
+        cairo_move_to(cr, spinex+eldx, riby);
+        riby += elstep;
+        cairo_line_to(cr, spinex-eldx, riby);
+        //cairo_rel_curve_to(cr, elstep/2,-halfstep, elstep,0, 0,halfstep);
+        //cairo_rel_curve_to(cr, halfstep,-elstep/2, 0,-elstep, -halfstep,0);
+        {
+            point_t p_a = r_rotate({-2*step/3, 0});
+            point_t p_b = r_rotate({-2*step/3, halfstep});
+            point_t p_c = r_rotate({0, halfstep});
+            cairo_rel_curve_to(cr, p_a.x,p_a.y, p_b.x,p_b.y, p_c.x,p_c.y);
+        }
+        break;
+    case 'y':
+        cairo_move_to(cr, spinex, riby);
+        riby += halfstep;
+        cairo_line_to(cr, leftx, riby);
+        break;
+    case 'm':
+        riby += 3*step/4;
+        cairo_move_to(cr, spinex, riby);
+        cairo_rel_curve_to(cr, 0,-step, step,-step, step,0);
+        break;
+    case 'n':
+        riby += 3*step/4;
+        cairo_move_to(cr, spinex-halfstep, riby);
+        cairo_rel_curve_to(cr, 0,-step, step,-step, step,0);
+        break;
+    case 'N':
+        riby += 3*step/4;
+        cairo_move_to(cr, leftx, riby);
+        cairo_rel_curve_to(cr, 0,-step, step,-step, step,0);
+        break;
+    default:
+        // unimplemented letter
+        cout << "unimplemented consonant: " << c << endl;
+        riby += halfstep;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex,riby, halfstep, 0,2*M_PI);
+        riby += halfstep;
+        break;
+    }
+}
+
+struct fills_t {
+    bool l_top;
+    bool c_top;
+    bool r_top;
+    bool l_bot;
+    bool c_bot;
+    bool r_bot;
+};
+
+fills_t consonant_fills(char c) {
+    switch (c) {
+    case 'b':
+    case 'p':
+        return {false, true, true, false, true, true};
+        break;
+    case 'v':
+    case 'f':
+        return {false, true, true, false, false, true};
+        break;
+    case 'D':
+    case 'T':
+        return {false, true, true, false, false, true};
+        break;
+    case 'd':
+    case 't':
+        return {true, true, true, true, true, true};
+        break;
+    case 'j':
+    case 'c':
+        return {true, true, true, false, false, true};
+        break;
+    case 'z':
+    case 's':
+        return {true, true, true, false, false, true};
+        break;
+    case 'Z':
+    case 'S':
+        return {true, true, true, false, false, true};
+        break;
+    case 'g':
+    case 'k':
+        return {true, true, false, true, true, false};
+        break;
+    case 'h':
+        return {true, true, false, true, true, false};
+        break;
+    case 'w':
+        return {false, false, true, false, true, false};
+        break;
+    case 'l':
+        return {false, false, true, true, false, false};
+        break;
+    case 'r':
+        return {false, false, true, true, false, false};
+        break;
+    case 'y':
+        return {false, true, false, true, false, false};
+        break;
+    case 'm':
+        return {false, false, true, false, true, true};
+        break;
+    case 'n':
+        return {false, true, false, true, true, true};
+        break;
+    case 'N':
+        return {true, false, false, true, true, false};
+        break;
+    case '`':
+        return {true, true, false, true, true, false};
+        break;
+    default:
+        // unimplemented letter
+        cout << "unimplemented consonant fill: " << c << endl;
+        return {false, true, false, false, true, false};
+        break;
+    }
+}
+
+vowel_space_t sb_t::vowel_space(char c) {
+    switch (c) {
+    case 'b':
+    case 'p':
+    case 'd':
+    case 't':
+    case 'g':
+    case 'k':
+        return {0,0};
+        break;
+    case 'v':
+    case 'f':
+    case 'z':
+    case 's':
+        return {0,0};
+        break;
+    case 'j':
+    case 'c':
+        return {0,0};
+        break;
+    case 'D':
+    case 'T':
+    case 'Z':
+    case 'S':
+        return {0,0};
+        break;
+    case 'h':
+        return {0,halfstep/2};
+        break;
+    case 'w':
+        return {0,0};
+        break;
+    case 'l':
+    case 'r':
+        return {0,elstep};
+        break;
+    case 'y':
+        return {0,step};
+        break;
+    case 'm':
+    case 'n':
+    case 'N':
+        return {step/4,0};
+        break;
+    case '`':
+        return {0,halfstep};
+        break;
+    default:
+        cout << "unimplemented vowel space: " << c << endl;
+        return {0,0};
+        break;
+    }
+}
+
+float sb_t::size_vowel_hook() {
+    return halfstep;
+}
+
+void sb_t::render_vowel_hook() {
+    cairo_new_sub_path(cr);
+    cairo_arc(cr, spinex-halfstep,riby, halfstep, 2*M_PI,M_PI);
+    riby += halfstep;
+}
+
+void sb_t::render_monopthong(char c, float x, float y) {
+    switch (c) {
+    case 'i':   // seat
+        x += halfstep/2 /2;
+        y += halfstep * sqrt(3)/2 /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, -halfstep/2, -halfstep * sqrt(3)/2);
+        stroke();
+        break;
+    case 'I':   // sit
+        x += halfstep * sqrt(3)/2 /2;
+        y += halfstep/2 /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, -halfstep * sqrt(3)/2, -halfstep/2);
+        stroke();
+        break;
+    case 'e':   // sate
+        x += halfstep /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, -halfstep, 0);
+        stroke();
+        break;
+    case 'E':   // set
+        x += halfstep * sqrt(3)/2 /2;
+        y -= halfstep/2 /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, -halfstep * sqrt(3)/2, +halfstep/2);
+        stroke();
+        break;
+    case 'A':   // sat
+        x += halfstep/2 /2;
+        y -= halfstep * sqrt(3)/2 /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, -halfstep/2, halfstep * sqrt(3)/2);
+        stroke();
+        break;
+    case 'a':   // sot
+        y -= halfstep /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, 0, halfstep);
+        stroke();
+        break;
+    case 'O':   // caught, if you don't merge with cot
+        x -= halfstep/2 /2;
+        y -= halfstep * sqrt(3)/2 /2;
+        /*
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep/2, halfstep * sqrt(3)/2);
+        stroke();
+        */
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep/2, halfstep * sqrt(3)/2);
+        stroke();
+
+        cairo_save(cr);
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 1,1,1);
+        fill();
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 0,0,0);
+        stroke();
+        cairo_restore(cr);
+
+        break;
+    case '@':   // sup (schwa-ish)
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        break;
+    case 'o':   // so
+        x -= halfstep /2;
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep, 0);
+        stroke();
+
+        cairo_save(cr);
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 1,1,1);
+        fill();
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 0,0,0);
+        stroke();
+        cairo_restore(cr);
+
+        break;
+    case 'U':   // soot
+        x -= halfstep * sqrt(3)/2 /2;
+        y += halfstep/2 /2;
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep * sqrt(3)/2, -halfstep/2);
+        stroke();
+
+        cairo_save(cr);
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 1,1,1);
+        fill();
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 0,0,0);
+        stroke();
+        cairo_restore(cr);
+
+        break;
+    case 'u':   // suit
+        x -= halfstep/2 /2;
+        y += halfstep * sqrt(3)/2 /2;
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep/2, -halfstep * sqrt(3)/2);
+        stroke();
+
+        cairo_save(cr);
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 1,1,1);
+        fill();
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 0,0,0);
+        stroke();
+        cairo_restore(cr);
+
+        break;
+    default:
+        cout << "unknown vowel: " << c << endl;
+        break;
+    }
+}
+
+void sb_t::render_i_dipthong(char c, float x, float y) {
+    switch (c) {
+    case 'e':   // !e ei say
+        x += halfstep /2 + halfstep/2 /2;
+        y += halfstep * sqrt(3)/2 /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, -halfstep, 0);
+        cairo_rel_line_to(cr, -halfstep/2, -halfstep * sqrt(3)/2);
+        stroke();
+        break;
+    case 'a':   // !a ai site
+        x += halfstep * sqrt(3)/2 /2;
+        y -= halfstep /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, 0, halfstep);
+        cairo_rel_line_to(cr, -halfstep * sqrt(3)/2, -halfstep/2);
+        stroke();
+        break;
+    case 'o':   // !o oi soy
+        x -= halfstep /2;
+        y += halfstep * sqrt(3)/2 /2;
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep, 0);
+        cairo_rel_line_to(cr, -halfstep/2, -halfstep * sqrt(3)/2);
+        stroke();
+
+        cairo_save(cr);
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 1,1,1);
+        fill();
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 0,0,0);
+        stroke();
+        cairo_restore(cr);
+
+        break;
+    default:
+        cout << "unknown i dipthong: " << c << endl;
+        return;
+        break;
+    }
+}
+
+void sb_t::render_u_dipthong(char c, float x, float y) {
+    switch (c) {
+    case 'a':   // ^a au south
+        x -= halfstep * sqrt(3)/2 /2;
+        y -= halfstep /2;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        fill();
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, 0, halfstep);
+        cairo_rel_line_to(cr, halfstep * sqrt(3)/2, -halfstep/2);
+        stroke();
+        break;
+    case 'o':   // ^o ou low
+        x -= halfstep /2 + halfstep/2 /2;
+        y += halfstep * sqrt(3)/2 /2;
+        cairo_move_to(cr, x, y);
+        cairo_rel_line_to(cr, halfstep, 0);
+        cairo_rel_line_to(cr, halfstep/2, -halfstep * sqrt(3)/2);
+        stroke();
+
+        cairo_save(cr);
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 1,1,1);
+        fill();
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x, y, dotrad, 0, 2*M_PI);
+        cairo_set_source_rgb(cr, 0,0,0);
+        stroke();
+        cairo_restore(cr);
+
+        break;
+    default:
+        cout << "unknown u dipthong: " << c << endl;
+        break;
+    }
+}
+
+bool vowel(char c) {
+    switch (c) {
+    case 'a':
+    case 'A':
+    case 'e':
+    case 'E':
+    case 'i':
+    case 'I':
+    case 'o':
+    case 'O':
+    case 'u':
+    case 'U':
+    case '!':
+    case '^':
+    case '@':
+        return true;
+        break;
+    default:
+        return false;
+        break;
+    }
+}
+
+bool voiced(char c) {
+    switch (c) {
+    case 'b':
+    case 'v':
+    case 'D':
+    case 'd':
+    case 'z':
+    case 'Z':
+    case 'g':
+        return true;
+        break;
+    default:
+        return false;
+        break;
+    }
+}
+
+bool logogram(char c) {
+    switch (c) {
+    case '&':
+    case 'X':
+        return true;
+        break;
+    default:
+        return false;
+        break;
+    }
+}
+
+float sb_t::size_logogram_word(string w) {
+    float size = nan();
+
+    if (w == "&") size = step*2;
+    else if (w == "XXX") size = step; // red mark for unknown word
+
+    return size;
+}
+
+void sb_t::render_logogram_word(string w) {
+    if (w == "&") {
+        cairo_new_sub_path(cr);
+        cairo_arc_negative(cr, spinex-halfstep,riby, halfstep, M_PI,2*M_PI);
+        cairo_rel_line_to(cr, 0, step);
+        cairo_rel_curve_to(cr, 0,step, -step,0, 0,0);
+        cairo_rel_curve_to(cr, halfstep,0, halfstep,step, 0,step);
+        cairo_rel_line_to(cr, -step, 0);
+        riby += step*2;
+    }
+    else if (w == "XXX") {
+        // red mark for unknown word
+        cairo_save(cr);
+        cairo_set_source_rgb(cr, 1,0,0);
+        cairo_rectangle(cr, spinex-halfstep,riby, step,step);
+        fill();
+        cairo_restore(cr);
+        riby += step;
+    }
+    else cout << "unknown logogram word: " << w << endl;
+
+    stroke();
+}
+
+float sb_t::size_vowel_word(string w) {
+    float size = nan();
+
+    if (w == "A") size = halfstep;
+    else if (w == "E") size = halfstep;
+    else if (w == "I") size = step;
+    else if (w == "O") size = step;
+    else if (w == "U") size = step;
+
+    return size;
+}
+
+void sb_t::render_vowel_word(string w) {
+    if (w == "A") {
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex,riby, halfstep, 2*M_PI,M_PI);
+        riby += halfstep;
+    }
+    else if (w == "E") {
+        cairo_arc(cr, spinex,riby, halfstep, 2*M_PI,M_PI);
+        riby += halfstep;
+        float vowely = riby - halfstep;
+        render_vowel("i", markx, vowely);
+    }
+    else if (w == "I") {
+        riby += step;
+        cairo_move_to(cr, spinex, riby);
+        cairo_rel_curve_to(cr, step,0, step,-step, step,-step);
+    }
+    else if (w == "O") {
+        riby += halfstep;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex,riby, halfstep, 0,2*M_PI);
+        riby += halfstep;
+    }
+    else if (w == "U") {
+        riby += halfstep;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex,riby, halfstep, 0,2*M_PI);
+        riby += halfstep;
+        float vowely = riby - halfstep;
+        render_vowel("u", markx, vowely);
+    }
+    else cout << "unknown vowel word: " << w << endl;
+
+    stroke();
+}
+
+float sb_t::size_digit(char c) {
+    float size = nan();
+
+    switch (c) {
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        size = step;
+        break;
+    case '#':
+        // ordinal ideogram
+        size = halfstep;
+        break;
+    default:
+        break;
+    }
+
+    return size;
+}
+
+void sb_t::render_digit(char c) {
+    switch (c) {
+    case '0':
+        cairo_move_to(cr, spinex-halfstep, riby);
+        cairo_line_to(cr, spinex+halfstep, riby);
+        cairo_line_to(cr, spinex+halfstep/2, riby+step/3);
+        cairo_curve_to(cr, spinex+halfstep,riby+step/3, spinex+halfstep,riby+step, spinex,riby+step);
+        cairo_curve_to(cr, spinex-step/3,riby+step, spinex-halfstep,riby+2*step/3, spinex-step/3,riby+halfstep);
+        riby += step;
+        break;
+    case '1':
+        cairo_move_to(cr, spinex, riby);
+        cairo_line_to(cr, spinex, riby+step);
+        riby += step;
+        break;
+    case '2':
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex+halfstep/2,riby, halfstep/2, 0,M_PI);
+        cairo_line_to(cr, spinex, riby+step);
+        riby += step;
+        break;
+    case '3':
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex+3*halfstep/2,riby, halfstep/2, 0,M_PI);
+        cairo_arc(cr, spinex+halfstep/2,riby, halfstep/2, 0,M_PI);
+        cairo_line_to(cr, spinex, riby+step);
+        riby += step;
+        break;
+    case '4':
+        cairo_move_to(cr, spinex+3*halfstep/2, riby);
+        cairo_line_to(cr, spinex+halfstep, riby+halfstep);
+        cairo_rel_curve_to(cr, 0,-3*halfstep/2, -halfstep,-3*halfstep/2, -halfstep,0);
+        cairo_line_to(cr, spinex, riby+step);
+        riby += step;
+        break;
+    case '5':
+        cairo_move_to(cr, spinex+halfstep, riby);
+        cairo_line_to(cr, spinex, riby+halfstep);
+        cairo_rel_curve_to(cr, step,0, -halfstep/2,halfstep, -halfstep/2,halfstep);
+        riby += step;
+        break;
+    case '6':
+        cairo_move_to(cr, spinex+halfstep, riby+halfstep);
+        cairo_rel_curve_to(cr, -step*2,0, 0,-step, 0,0);
+        cairo_rel_curve_to(cr, 0,halfstep, -step,halfstep, -step,halfstep);
+        cairo_line_to(cr, spinex+halfstep, riby+step);
+        riby += step;
+        break;
+    case '7':
+        cairo_move_to(cr, spinex-halfstep, riby);
+        cairo_curve_to(cr, spinex,riby+halfstep/2, spinex,riby+halfstep/2, spinex+halfstep,riby+halfstep/4);
+        cairo_curve_to(cr, spinex+step,riby, spinex+step/2,riby-step/2+halfstep/8, spinex+halfstep,riby+halfstep/4);
+        cairo_line_to(cr, spinex, riby+step);
+        cairo_line_to(cr, spinex-halfstep, riby+halfstep);
+        riby += step;
+        break;
+    case '8':
+        cairo_move_to(cr, spinex-halfstep, riby);
+        cairo_curve_to(cr, spinex-halfstep,riby+halfstep, spinex+halfstep/2,riby+halfstep, spinex+halfstep/2,riby);
+        cairo_line_to(cr, spinex-halfstep, riby+step);
+        cairo_line_to(cr, spinex+halfstep, riby+step);
+        riby += step;
+        break;
+    case '9':
+        cairo_move_to(cr, spinex, riby+halfstep);
+        cairo_curve_to(cr, spinex-step,riby+halfstep/2, spinex,riby-halfstep, spinex,riby+halfstep);
+        cairo_line_to(cr, spinex, riby+step);
+        riby += step;
+        break;
+    case '#':
+        // ordinal ideogram
+        cairo_move_to(cr, leftx, riby);
+        cairo_line_to(cr, spinex, riby);
+        cairo_rel_curve_to(cr, -2*step/3,0, -2*step/3,halfstep, 0,halfstep);
+        riby += halfstep;
+        cairo_line_to(cr, rightx, riby);
+        break;
+    default:
+        cout << "unknown digit: " << c << endl;
+        break;
+    }
+}
+
+float sb_t::size_numeral(string w) {
+    float size = 0;
+
+    for (char c : w) {
+        if (isalpha(c)) {
+            // assume it's an ordinal
+            size += size_digit('#');
+            break;
+        }
+
+        size += size_digit(c);
+        size += wordstep/2; //TODO omit this at end of numeral?
+    }
+
+    return size;
+}
+
+void sb_t::render_numeral(string w) {
+    for (char c : w) {
+        if (isalpha(c)) {
+            // assume it's an ordinal
+            render_digit('#');
+            break;
+        }
+
+        render_digit(c);
+        riby += wordstep/2;
+    }
+
+    stroke();
+}
+
+void sb_t::render_vowel(string v, float x, float y) {
+    cairo_path_t * saved_path = cairo_copy_path(cr);
+    cairo_new_path(cr);
+
+    if (v[0] == '!') render_i_dipthong(v[1], x, y);
+    else if (v[0] == '^') render_u_dipthong(v[1], x, y);
+    else render_monopthong(v[0], x, y);
+
+    cairo_new_path(cr);
+    cairo_append_path(cr, saved_path);
+    cairo_path_destroy(saved_path);
+}
+
+vector<string> split_vowels(string text) {
+    vector<string> vs;
+
+    int ix = 0;
+    while (ix < text.length()) {
+        if (text[ix] == '!' || text[ix] == '^') {
+            vs.push_back(text.substr(ix, 2));
+            ix += 2;
+        }
+        else {
+            vs.push_back(text.substr(ix, 1));
+            ix += 1;
+        }
+    }
+
+    return vs;
+}
+
+float sb_t::size_punct(string w) {
+    float size = nan();
+
+    if (w == "-") size = 0;
+    else if (w == "--" || w == ";" || w == ":") size = step;
+    else if (w == "----") size = wordstep*2;
+    else if (w == ",") size = 0;
+    else if (w == ".") size = halfstep;
+    else if (w == "!") size = 0;
+    else if (w == "?") size = 0;
+    else if (w == "\"") size = ribstep;
+    else if (w == "(") size = 0;
+    else if (w == ")") size = 0;
+    else if (w == "/") size = 0;   //TODO move this into word object
+
+    return size;
+}
+
+void sb_t::render_punct(string w) {
+    cairo_path_t * saved_path = cairo_copy_path(cr);
+    cairo_new_path(cr);
+
+    if (w == "-") {
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
+        fill();
+    }
+    else if (w == "--" || w == ";" || w == ":") {
+        cairo_move_to(cr, spinex-step-halfstep, riby);
+        cairo_line_to(cr, spinex-halfstep-halfstep, riby+halfstep);
+        cairo_line_to(cr, spinex-step-halfstep, riby+step);
+        cairo_move_to(cr, spinex-halfstep-halfstep, riby+halfstep);
+        cairo_line_to(cr, spinex-halfstep, riby+halfstep);
+        stroke();
+        riby += step;
+    }
+    else if (w == "----") {
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
+        riby += wordstep;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
+        riby += wordstep;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
+        /*
+        riby += wordstep;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, spinex, riby, dotrad, 0, 2*M_PI);
+        */
+        fill();
+    }
+    else if (w == ",") {
+        cairo_move_to(cr, spinex-step-halfstep, riby-halfstep);
+        cairo_line_to(cr, spinex-halfstep-halfstep, riby);
+        cairo_line_to(cr, spinex-step-halfstep, riby+halfstep);
+        stroke();
+    }
+    else if (w == ".") {
+        cairo_move_to(cr, spinex-step-halfstep, riby-halfstep);
+        cairo_line_to(cr, spinex-step-halfstep, riby);
+        cairo_line_to(cr, spinex, riby);
+        stroke();
+        riby += halfstep;
+    }
+    else if (w == "!") {
+        cairo_move_to(cr, spinex-step-halfstep/2, riby-step);
+        cairo_rel_curve_to(cr, -step,halfstep, halfstep,halfstep, -halfstep,step);
+        cairo_line_to(cr, spinex, riby);
+        stroke();
+    }
+    else if (w == "?") {
+        cairo_move_to(cr, spinex-step-halfstep, riby-halfstep);
+        cairo_rel_curve_to(cr, 0,-halfstep, step,-halfstep, 0,halfstep);
+        cairo_line_to(cr, spinex, riby);
+        stroke();
+    }
+    else if (w == "\"") {
+        cairo_move_to(cr, spinex-step-halfstep, riby);
+        cairo_line_to(cr, spinex-step, riby);
+        riby += ribstep;
+        cairo_move_to(cr, spinex-step-halfstep, riby);
+        cairo_line_to(cr, spinex-step, riby);
+        stroke();
+    }
+    else if (w == "(") {
+        cairo_move_to(cr, spinex, riby);
+        cairo_rel_curve_to(cr, -step,0, -step-halfstep,halfstep, -step-halfstep,step);
+        stroke();
+    }
+    else if (w == ")") {
+        cairo_move_to(cr, spinex, riby);
+        cairo_rel_curve_to(cr, -step,0, -step-halfstep,-halfstep, -step-halfstep,-step);
+        stroke();
+    }
+    else cout << "unknown punct: " << w << endl;
+
+    cairo_new_path(cr);
+    cairo_append_path(cr, saved_path);
+    cairo_path_destroy(saved_path);
+}
+
+bool isprosody(char c) {
+    switch (c) {
+    case '/':
+    case '-':
+    case ',':
+    case '.':
+    case '!':
+    case '?':
+    case '(':
+    case ')':
+    case '"':
+    case ';':
+    case ':':
+        return true;
+        break;
+    default:
+        return false;
+        break;
+    }
+}
+
+void sbj_t::render_column_divider() {
+    next_column();
+
+    float col_top = target.margin + inner_row_height * (cur_row-1);
+    float col_bot = col_top + column_height;
+
+    need_fresh_column = true;
+
+    if (! target.drawing) return;
+
+    float frac = column_height / 3;
+
+    cairo_move_to(scr, spinex, col_top+frac);
+    cairo_line_to(scr, spinex, col_bot-frac);
+    target.stroke(scr);
+}
+
+float sb_t::size_phonetic_word(string w) {
+    STAGE_TIMER(STAGE_SIZE_PHONETIC_WORD);
+
+    float temp_riby = starty;
+
+    if (logogram(w[0])) {
+        return size_logogram_word(w);
+    }
+
+    // this must come before vowel() because '!' is a "vowel"
+    if (isprosody(w[0])) {
+        return size_punct(w);
+    }
+
+    if (vowel(w[0])) {
+        return size_vowel_word(w);
+    }
+
+    if (isdigit(w[0])) {
+        return size_numeral(w);
+    }
+
+    if (w[0] != '`') temp_riby += ribstep/2;
+
+    int ix = 0;
+    int lastrib_ix;
+    while (ix < w.length()) {
+        int nextrib_ix = ix + 1;
+        while (nextrib_ix<w.length() && vowel(w[nextrib_ix])) nextrib_ix += 1;
+
+        float prerib_riby = temp_riby;
+        if (w[ix] == '`') temp_riby += size_vowel_hook();
+        else temp_riby += size_consonant(w[ix]);
+        float rib_height = temp_riby - prerib_riby;
+
+        float pregap_riby = temp_riby;
+
+        // do current and next ribs need a gap?
+        fills_t fills = consonant_fills(w[ix]);
+        if (nextrib_ix<w.length()) {
+            fills_t fills2 = consonant_fills(w[nextrib_ix]);
+            if (fills.l_bot && fills2.l_top
+             || fills.c_bot && fills2.c_top
+             || fills.r_bot && fills2.r_top
+             ) {
+                // gap
+                temp_riby += ribstep;
+            }
+            else {
+                // no gap
+                //XXX experiment with small gap due to eg "disquiet"
+                temp_riby += ribstep/3;
+            }
+        }
+        else {
+            // no next rib
+            lastrib_ix = ix;
+        }
+
+        // size vowel if any
+        float vowely_center;
+        if (nextrib_ix < w.length() && vowel(w[ix+1])) {
+            // there's a vowel then a following rib
+            string vtext = w.substr(ix + 1, nextrib_ix - ix - 1);
+            vector<string> vs = split_vowels(vtext);
+
+            if (w[ix] == '`') vowely_center = pregap_riby - halfstep/2;
+            else if (w[nextrib_ix] == '`') vowely_center = temp_riby + halfstep/2;
+            else {
+                // next rib is a consonant
+                float prevy, nexty;
+
+                // this only works because voiced ribs never have vowel space
+                if (voiced(w[ix])) {
+                    prevy = pregap_riby - rib_height/2 + voicedlen/2;
+                }
+                else prevy = pregap_riby - vowel_space(w[ix]).after;
+
+                if (voiced(w[nextrib_ix])) {
+                    //TODO assume 0 because we don't know height of next rib
+                    nexty = temp_riby + 0/2 - voicedlen/2;
+                }
+                else nexty = temp_riby + vowel_space(w[nextrib_ix]).before;
+
+                float vowel_room = nexty - prevy;
+                float vowel_needs = vowel_size * vs.size();
+                if (vowel_room < vowel_needs) {
+                    float skootch = vowel_needs - vowel_room;
+                    temp_riby += skootch;
+                    nexty += skootch;
+                }
+
+                vowely_center = (prevy + nexty) / 2;
+            }
+        }
+
+        ix = nextrib_ix;
+    }
+
+    if (w[lastrib_ix] == '`') temp_riby -= halfstep;
+    else temp_riby += ribstep/2;
+
+    if (w[lastrib_ix] == '`') temp_riby += halfstep;
+
+    return temp_riby - starty;
+}
+
+void sb_t::render_phonetic_word(string w) {
+    riby = starty;
+
+    if (logogram(w[0])) {
+        render_logogram_word(w);
+        return;
+    }
+
+    // this must come before vowel() because '!' is a "vowel"
+    if (isprosody(w[0])) {
+        render_punct(w);
+        return;
+    }
+
+    if (vowel(w[0])) {
+        render_vowel_word(w);
+        return;
+    }
+
+    if (isdigit(w[0])) {
+        render_numeral(w);
+        return;
+    }
+
+    if (w[0] != '`') riby += ribstep/2;
+
+    int ix = 0;
+    int lastrib_ix;
+    while (ix < w.length()) {
+        int nextrib_ix = ix + 1;
+        while (nextrib_ix<w.length() && vowel(w[nextrib_ix])) nextrib_ix += 1;
+
+        float prerib_riby = riby;
+        if (w[ix] == '`') render_vowel_hook();
+        else render_consonant(w[ix]);
+        float rib_height = riby - prerib_riby;
+
+        float pregap_riby = riby;
+
+        // do current and next ribs need a gap?
+        fills_t fills = consonant_fills(w[ix]);
+        if (nextrib_ix<w.length()) {
+            fills_t fills2 = consonant_fills(w[nextrib_ix]);
+            if (fills.l_bot && fills2.l_top
+             || fills.c_bot && fills2.c_top
+             || fills.r_bot && fills2.r_top
+             ) {
+                // gap
+                riby += ribstep;
+            }
+            else {
+                // no gap
+                //XXX experiment with small gap due to eg "disquiet"
+                riby += ribstep/3;
+            }
+        }
+        else {
+            // no next rib
+            lastrib_ix = ix;
+        }
+
+        // render vowel if any
+        float vowely_center;
+        if (nextrib_ix < w.length() && vowel(w[ix+1])) {
+            // there's a vowel then a following rib
+            string vtext = w.substr(ix + 1, nextrib_ix - ix - 1);
+            vector<string> vs = split_vowels(vtext);
+
+            if (w[ix] == '`') vowely_center = pregap_riby - halfstep/2;
+            else if (w[nextrib_ix] == '`') vowely_center = riby + halfstep/2;
+            else {
+                // next rib is a consonant
+                float prevy, nexty;
+
+                // this only works because voiced ribs never have vowel space
+                if (voiced(w[ix])) {
+                    prevy = pregap_riby - rib_height/2 + voicedlen/2;
+                }
+                else prevy = pregap_riby - vowel_space(w[ix]).after;
+
+                if (voiced(w[nextrib_ix])) {
+                    //TODO assume 0 because we don't know height of next rib
+                    nexty = riby + 0/2 - voicedlen/2;
+                }
+                else nexty = riby + vowel_space(w[nextrib_ix]).before;
+
+                float vowel_room = nexty - prevy;
+                float vowel_needs = vowel_size * vs.size();
+                if (vowel_room < vowel_needs) {
+                    float skootch = vowel_needs - vowel_room;
+                    riby += skootch;
+                    nexty += skootch;
+                }
+
+                vowely_center = (prevy + nexty) / 2;
+            }
+
+            float vowely = vowely_center - vowel_size * (vs.size()-1) / 2.0;
+            for (string v : vs) {
+                render_vowel(v, markx, vowely);
+                vowely += vowel_size;
+            }
+        }
+
+        ix = nextrib_ix;
+    }
+
+    if (w[lastrib_ix] == '`') riby -= halfstep;
+    else riby += ribstep/2;
+
+    cairo_move_to(cr, spinex, starty);
+    cairo_line_to(cr, spinex, riby);
+
+    if (w[lastrib_ix] == '`') riby += halfstep;
+
+    if (emphasis) {
+        cairo_move_to(cr, spinex-step-halfstep, starty);
+        cairo_line_to(cr, spinex-step-halfstep, riby);
+    }
+
+    stroke();
+}
+
+// draws ws[first] to ws[last-1]
+void sb_t::render_phonetic_words(const word_list_t & ws, size_t first, size_t last) {
+    STAGE_TIMER(STAGE_RENDER_PHONETIC_WORDS);
+
+    for (size_t ix = first; ix < last; ix += 1) {
+        if (ws.is(ix, '/')) {
+            emphasis = ! emphasis;
+            continue;
+        }
+
+        // pages that aren't drawn only need the emphasis state kept up to date
+        if (! target.drawing) continue;
+
+        string w = ws[ix];
+
+        // a word's shape depends only on its spelling, scale and emphasis
+        if (target.mark_glyphs) {
+            string key = w + " " + to_string(scale) + (emphasis ? " /" : "");
+            target.begin_glyph(cr, key, spinex, starty);
+        }
+        render_phonetic_word(w);
+        if (target.mark_glyphs) target.end_glyph();
+        starty = riby + wordstep;
+    }
+}
+
+map<string, string> pronunciation;
+
+// the word as looked up in pronunciation, or "" for numbers and prosody
+string pronunciation_key(string raw_w) {
+    if (isdigit(raw_w[0])) return "";
+    if (isprosody(raw_w[0])) return "";
+    if (raw_w[0] == '\'') raw_w = raw_w.substr(1);
+
+    string w;
+    for (char c : raw_w) w.push_back(tolower(c));
+    return w;
+}
+
+string phoneticize_word(string raw_w) {
+    if (isdigit(raw_w[0])) return raw_w;
+    if (isprosody(raw_w[0])) return raw_w;
+
+    string w = pronunciation_key(raw_w);
+    if (w.empty()) return "";
+
+    // find() rather than [] so that concurrent lookups never insert
+    auto it = pronunciation.find(w);
+    if (it != pronunciation.end()) return it->second;
+
+    cout << "unknown word: " << raw_w << endl;
+    return "XXX"; // red mark for unknown word
+}
+
+word_list_t phoneticize_words(const word_list_t & ws) {
+    STAGE_TIMER(STAGE_PHONETICIZE_WORDS);
+    TRACE_SPAN("phoneticize");
+
+    word_list_t ps;
+    ps.chars.reserve(ws.chars.size());
+    ps.ends.reserve(ws.size());
+    for (size_t ix = 0; ix < ws.size(); ix += 1) {
+        string p = phoneticize_word(ws[ix]);
+        if (p.length() != 0) ps.push_back(p);
+    }
+    COUNT_TOKENS(ps.size());
+    return ps;
+}
+
+set<string> abbrevs = {"Mrs", "Mr", "St", "EDW", "E", "M"};
+
+size_t word_list_t::size() const {
+    return ends.size();
+}
+
+bool word_list_t::empty() const {
+    return ends.empty();
+}
+
+string word_list_t::operator[](size_t ix) const {
+    uint32_t start = ix ? ends[ix-1] : 0;
+    return chars.substr(start, ends[ix] - start);
+}
+
+bool word_list_t::is(size_t ix, char c) const {
+    uint32_t start = ix ? ends[ix-1] : 0;
+    return ends[ix] - start == 1 && chars[start] == c;
+}
+
+void word_list_t::push_back(const string & w) {
+    chars += w;
+    ends.push_back(chars.size());
+}
+
+word_list_t split_words(const string & text) {
+    STAGE_TIMER(STAGE_SPLIT_WORDS);
+    TRACE_SPAN("tokenize");
+
+    // no longer than the text, so neither buffer grows
+    word_list_t ws;
+    ws.chars.reserve(text.size());
+    ws.ends.reserve(text.size());
+    string w;
+
+    for (char c : text) {
+        if (isspace(c)) {
+            if (! w.empty()) {
+                ws.push_back(w);
+                w.clear();
+            }
+        }
+        else if (isdigit(c)) {
+            if (w.empty() || isdigit(w.back())) w.push_back(c);
+            else {
+                ws.push_back(w);
+                w.clear();
+                w.push_back(c);
+            }
+        }
+        else if (isalpha(c) || c == '\'') {
+            if (w.empty() || isalpha(w.back()) || w.back() == '\'') {
+                w.push_back(c);
+            }
+            else if (isdigit(w.back())) w.push_back(c);
+            else {
+                ws.push_back(w);
+                w.clear();
+                w.push_back(c);
+            }
+        }
+        else if (c == '-') {
+            if (w.empty() || w.back() == '-') w.push_back(c);
+            else {
+                ws.push_back(w);
+                w.clear();
+                w.push_back(c);
+            }
+        }
+        else if (c == '.') {
+            if (w.empty()) ws.push_back(string(1, c));
+            else if (abbrevs.count(w) == 0) {
+                ws.push_back(w);
+                w.clear();
+                ws.push_back(string(1, c));
+            }
+        }
+        else switch (c) {
+        case '"':
+        case ',':
+        case ';':
+        case ':':
+        case '!':
+        case '?':
+        case '(':
+        case ')':
+            if (! w.empty()) {
+                ws.push_back(w);
+                w.clear();
+            }
+            ws.push_back(string(1, c));
+            break;
+        case '_':
+            if (! w.empty()) {
+                ws.push_back(w);
+                w.clear();
+            }
+            ws.push_back(string(1, '/'));
+            break;
+        default:
+            cout << "can't handle character: " << c << endl;
+            break;
+        }
+    }
+    if (! w.empty()) ws.push_back(w);
+
+    return ws;
+}
+
+void sb_t::render_at_inches(string text, float x, float y) {
+    word_list_t ps = phoneticize_words(split_words(text));
+
+    spinex = x;
+    leftx = spinex - step;
+    rightx = spinex + step;
+    markx = rightx + halfstep;
+
+    starty = y;
+    riby = starty;
+
+    render_phonetic_words(ps, 0, ps.size());
+}
+
+void sb_t::build_digit_paths() {
+    spinex = 0;
+    for (char c = '0'; c <= '9'; c += 1) {
+        riby = 0;
+        render_digit(c);
+        digit_paths.push_back(cairo_copy_path(cr));
+        cairo_new_path(cr);
+    }
+}
+
+// same strokes as render_at_inches(to_string(n), x, y), without the text
+// pipeline
+void sb_t::render_number_at_inches(int n, float x, float y) {
+    char digits[16];
+    snprintf(digits, sizeof(digits), "%d", n);
+
+    riby = y;
+    for (char * d = digits; * d; d += 1) {
+        cairo_save(cr);
+        cairo_translate(cr, x, riby);
+        cairo_append_path(cr, digit_paths[* d - '0']);
+        cairo_restore(cr);
+
+        riby += step + wordstep/2;
+    }
+
+    stroke();
+}
+
+// a column of ws[first] to ws[last-1]
+void sbj_t::place_column(const word_list_t & ws, size_t first, size_t last) {
+    columns_filled += 1;
+    words_placed += last - first;
+    if (target.page_number != last_filled_page || cur_row != last_filled_row) {
+        rows_filled += 1;
+        last_filled_page = target.page_number;
+        last_filled_row = cur_row;
+    }
+
+    TRACE_SPAN("render", target.page_number);
+    render_phonetic_words(ws, first, last);
+}
+
+void sbj_t::render_columns(string text) {
+    word_list_t ps = phoneticize_words(split_words(text));
+
+    TRACE_SPAN("layout", target.page_number);
+    size_t col_first = 0;   // the column being filled is ps[col_first] to ps[ix-1]
+    float col_size = 0;
+    for (size_t ix = 0; ix < ps.size(); ix += 1) {
+        if (need_fresh_column) next_column();
+
+        float word_size = size_phonetic_word(ps[ix]);
+        if (token_sizes) token_sizes->push_back(word_size);
+        if (col_size + word_size <= column_height) {
+            col_size += word_size + wordstep;
+        }
+        else {
+            place_column(ps, col_first, ix);
+            col_first = ix;
+            col_size = word_size + wordstep;
+
+            need_fresh_column = true;
+        }
+    }
+
+    if (col_first < ps.size()) {
+        place_column(ps, col_first, ps.size());
+        need_fresh_column = true;
+    }
+}
+
+
+void sb_t::draw_skull_bat(float width, float x, float y) {
+    cairo_surface_t * skullbat = cached_image("skullbat.png");
+    cairo_save(cr);
+    int w = cairo_image_surface_get_width(skullbat);
+    cairo_translate(cr, x, y);
+    cairo_scale(cr, width /w, width /w);
+    cairo_set_source_surface(cr, skullbat, 0,0);
+    target.paint_image(cr, "skullbat.png");
+    cairo_restore(cr);
+}
+
+void kp_t::render_latin(string text, float x, float y) {
+    cairo_set_source_rgb(cr, 0,0,0);
+    cairo_move_to(cr, x, y);
+    target.show_text(cr, text);
+}
+
+void kp_t::render_skullbat(string text, float x, float y) {
+    spinex = x;
+    leftx = spinex - step;
+    rightx = spinex + step;
+    markx = rightx + halfstep;
+
+    starty = y;
+    riby = starty;
+
+    render_phonetic_word(text);
+}
+
+// The key page is the same in every book of a size, so it is drawn once,
+// recorded, and kept in KEY_PAGE_CACHE for later runs, which replay it
+// without drawing it again.  Its labels are recorded as text as well as
+// outlines, so cairo pdfs still show them as selectable text (looking up
+// just the two faces), and the other writers draw the outlines.  A cache
+// that doesn't match or doesn't validate is rebuilt.
+const char * KEY_PAGE_CACHE = "keypage.cache";
+const uint32_t KEY_PAGE_MAGIC = 0x504b424b;   // "KBKP"
+const uint32_t KEY_PAGE_VERSION = 3;
+
+struct key_page_key_t {
+    uint32_t engine_version;
+    float scale;
+    float paper_width;
+    float paper_height;
+    float margin;
+};
+
+bool operator==(const key_page_key_t & a, const key_page_key_t & b) {
+    return a.engine_version == b.engine_version && a.scale == b.scale
+        && a.paper_width == b.paper_width && a.paper_height == b.paper_height
+        && a.margin == b.margin;
+}
+
+mutex key_page_mutex;
+bool key_page_loaded = false;
+key_page_key_t key_page_key;
+display_list_t key_page;
+
+bool load_key_page(const key_page_key_t & key) {
+    ifstream in(KEY_PAGE_CACHE, ios::binary);
+    uint32_t magic, version;
+    if (! read_pod(in, magic) || magic != KEY_PAGE_MAGIC) return false;
+    if (! read_pod(in, version) || version != KEY_PAGE_VERSION) return false;
+
+    key_page_key_t saved;
+    if (! read_pod(in, saved) || ! (saved == key)) return false;
+
+    display_list_t dl;
+    if (! read_display_list(in, dl)) return false;
+    swap(key_page, dl);
+    return true;
+}
+
+void save_key_page(const key_page_key_t & key) {
+    ofstream out(KEY_PAGE_CACHE, ios::binary);
+    write_pod(out, KEY_PAGE_MAGIC);
+    write_pod(out, KEY_PAGE_VERSION);
+    write_pod(out, key);
+    write_display_list(out, key_page);
+}
+
+void kp_t::render_key_page() {
+    if (! target.drawing) return;
+
+    key_page_key_t key = {ENGINE_VERSION, scale, target.paper_width,
+                          target.paper_height, target.margin};
+
+    lock_guard<mutex> lock(key_page_mutex);
+    if (! key_page_loaded || ! (key_page_key == key)) {
+        key_page_key = key;
+        key_page_loaded = true;
+        if (! load_key_page(key)) {
+            collect_sink_t sink;
+            target_t rec(RECORD_TARGET, & sink, target.paper_width,
+                         target.paper_height, target.margin);
+            rec.number_pages = false;
+            rec.mark_glyphs = false;
+            rec.new_page();
+            {
+                keypage_context_t kp(rec, scale);
+                kp.draw_key_page();
+            }
+            rec.save_and_close();
+            swap(key_page, sink.pages[0].dl);
+            save_key_page(key);
+        }
+    }
+
+    target.draw_fragment(key_page);
+}
+
+void kp_t::draw_key_page() {
+    draw_skull_bat(1, target.paper_width/2-0.5, target.margin - 3.0/4.0 /2);
+
+    set_skullbat_scale(1.5);
+
+    cairo_select_font_face(cr, "DejaVu Serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+    cairo_set_font_size(cr, FONT_SIZE/POINTS_PER_INCH);
+
+    cairo_font_extents_t fe;
+    cairo_text_extents_t te;
+    cairo_font_extents(cr, & fe);
+
+    int x = 0;
+    int y = 0;
+
+    render_latin("Skullbat Key", target.margin, target.margin+fe.height+ y *1.5*fe.height);
+
+    cairo_select_font_face(cr, "DejaVu Serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_font_extents(cr, & fe);
+    cairo_text_extents(cr, "W", & te);
+
+    y += 1;
+    render_latin("Consonants", target.margin, target.margin+fe.height + y *1.5*fe.height);
+    y += 1;
+    render_latin("(voicing mark is optional if unambiguous)", target.margin, target.margin+fe.height + y *1.5*fe.height);
+
+    const float SKT = 1.6667;
+
+    y += 1;
+    x = 0;
+    for (string s : {"P","B","M","F","V","W"}) {
+        render_latin(s, target.margin+x*0.6, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"p","b","m","f","v","w"}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    x = 0;
+    for (string s : {"","","","TH","DH",""}) {
+        float nudge = s.length() > 1 ? 0.1 : 0;
+        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"","","","T","D",""}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    x = 0;
+    for (string s : {"T","D","N","S","Z","L"}) {
+        render_latin(s, target.margin+x*0.6, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"t","d","n","s","z","l"}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    x = 0;
+    for (string s : {"","","","SH","ZH","R"}) {
+        float nudge = s.length() > 1 ? 0.1 : 0;
+        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"","","","S","Z","r"}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    x = 0;
+    for (string s : {"K","G","NG","","","Y"}) {
+        float nudge = s.length() > 1 ? 0.1 : 0;
+        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"k","g","N","","","y"}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    x = 0;
+    for (string s : {"","","","H","",""}) {
+        float nudge = s.length() > 1 ? 0.1 : 0;
+        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"","","","h","",""}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    render_latin("Vowels", target.margin, target.margin+fe.height + y *1.5*fe.height);
+
+    y += 1;
+    render_latin("Full words only", target.margin, target.margin+fe.height + y *1.5*fe.height);
+
+    y += 1;
+    x = 0;
+    for (string s : {"A","E","I","O","OO"}) {
+        float nudge = s.length() > 1 ? 0.1 : 0;
+        render_latin(s, target.margin+x*0.6-nudge, target.margin+fe.height + y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"A","E","I","O","U"}) {
+        if (s.length()) render_skullbat(s, target.margin+x*0.6+te.width*SKT, target.margin+fe.height*2/3 + y *1.5*fe.height -size_phonetic_word(s)/2);
+        x += 1;
+    }
+
+    y += 1;
+    render_latin("Diacritics (optional if unambiguous)", target.margin, target.margin+fe.height+ y *1.5*fe.height);
+    set_skullbat_scale(3);
+
+    y += 1;
+    render_latin("monopthongs", target.margin, target.margin+fe.height+ y *1.5*fe.height);
+
+    int yy = 0;
+
+    y += 1;
+
+    x = 0;
+    yy = y;
+    for (string s : {"i","ɪ","e","ɛ","æ"}) {
+        render_latin("/"+s+"/", target.margin+x*1.0, target.margin+fe.height+ yy *1.5*fe.height);
+        yy += 1;
+    }
+    yy = y;
+    for (string s : {"i","I","e","E","A"}) {
+        if (s.length()) render_vowel(s, target.margin+x*1.0+te.width*2.5, target.margin+fe.height*2.0/3.0 + yy *1.5*fe.height);
+        yy += 1;
+    }
+    x = 1;
+    yy = y;
+    for (string s : {"","","ə","","a"}) {
+        if (s.length()) render_latin("/"+s+"/", target.margin+x*1.0, target.margin+fe.height+ yy *1.5*fe.height);
+        yy += 1;
+    }
+    yy = y;
+    for (string s : {"","","@","","a"}) {
+        if (s.length()) render_vowel(s, target.margin+x*1.0+te.width*2.5, target.margin+fe.height*2.0/3.0 + yy *1.5*fe.height);
+        yy += 1;
+    }
+    x = 2;
+    yy = y;
+    for (string s : {"u","ʊ","o","","ɒ"}) {
+        if (s.length()) render_latin("/"+s+"/", target.margin+x*1.0, target.margin+fe.height+ yy *1.5*fe.height);
+        yy += 1;
+    }
+    yy = y;
+    for (string s : {"u","U","o","","O"}) {
+        if (s.length()) render_vowel(s, target.margin+x*1.0+te.width*2.5, target.margin+fe.height*2.0/3.0 + yy *1.5*fe.height);
+        yy += 1;
+    }
+
+    y += 5;
+    render_latin("dipthongs", target.margin, target.margin+fe.height + y *1.5*fe.height);
+
+    y += 1;
+    x = 0;
+    for (string s : {"ei","ai","oi","au","ou"}) {
+        render_latin("/"+s+"/", target.margin+x*0.7, target.margin+fe.height+ y *1.5*fe.height);
+        x += 1;
+    }
+    x = 0;
+    for (string s : {"!e","!a","!o","^a","^o"}) {
+        render_vowel(s, target.margin+x*0.7+te.width*2.5, target.margin+fe.height*2.0/3.0 + y *1.5*fe.height);
+        x += 1;
+    }
+
+    set_skullbat_scale(1);
+}
+
+void load_phonetic() {
+    STAGE_TIMER(STAGE_LOAD_PHONETIC);
+    TRACE_SPAN("load_phonetic");
+
+    ifstream phonetics("pronunciation.txt");
+    string word, phonetic;
+    while (phonetics >> word >> phonetic) {
+        pronunciation[word] = phonetic;
+    }
+}
+
+// build_phonetic.py folds extras.txt into pronunciation.txt; watch mode
+// reads it over the top so that edits to it show without rebuilding
+void load_extras() {
+    ifstream extras("extras.txt");
+    string word, phonetic;
+    while (extras >> word >> phonetic) {
+        pronunciation[word] = phonetic;
+    }
+}
+
+cairo_status_t append_to_string(void * closure, const unsigned char * data,
+                                unsigned int length) {
+    ((string *) closure)->append((const char *) data, length);
+    return CAIRO_STATUS_SUCCESS;
+}
+
+page_sink_t * open_sink(string filename, float width, float height) {
+    switch (output_format) {
+    case NATIVE_PDF_OUTPUT: {
+        pdf_writer_t * writer = new pdf_writer_t(filename, width, height);
+        writer->fast = fast_pdf;
+        return writer;
+    }
+    case SVG_OUTPUT:
+        return new svg_writer_t(filename, false, width, height);
+    case HTML_OUTPUT:
+        return new svg_writer_t(filename, true, width, height);
+    case PNG_OUTPUT:
+        return new png_writer_t(filename, png_dpi, png_pages, png_contact_sheet,
+                                max(1u, thread::hardware_concurrency()),
+                                width, height);
+    case HPGL_OUTPUT:
+        return new plot_writer_t(filename, HPGL, width, height);
+    case GCODE_OUTPUT:
+        return new plot_writer_t(filename, GCODE, width, height);
+    default:
+        return new pdf_sink_t(filename, width, height);
+    }
+}
+
+para_kind_t classify_para(const string & para) {
+    if (para.find(STARS) != string::npos) return DIVIDER_PARA;
+    else if (para.compare(0, 7, "Chapter") == 0) return HEADING_PARA;
+    else return BODY_PARA;
+}
+
+bool para_reader_t::next(para_t & para) {
+    STAGE_TIMER(STAGE_READ_PARAGRAPH);
+
+    if (done) return false;
+
+    para.text.clear();
+    if (at_end) {
+        done = true;
+        para.kind = KEY_PAGE;
+        return true;
+    }
+
+    while (getline(in, line)) {
+        if (line.compare(0, 7, "Chapter") == 0) title_page = false;
+
+        if (line.empty()) {
+            para.kind = title_page ? TITLE_PARA : classify_para(para.text);
+            return true;
+        }
+        para.text += line;
+        para.text += ' ';
+    }
+
+    at_end = true;
+    para.kind = classify_para(para.text);
+    return true;
+}
+
+// the whole book in reading order, ending with the key page
+vector<para_t> load_book(string filename) {
+    para_reader_t reader(filename);
+    vector<para_t> book;
+    para_t para;
+    while (reader.next(para)) book.push_back(para);
+    return book;
+}
+
+// headings and the key page start by opening a new page
+bool opens_page(const para_t & para) {
+    return para.kind == HEADING_PARA || para.kind == KEY_PAGE;
+}
+
+bool operator==(const layout_state_t & a, const layout_state_t & b) {
+    return a.page_number == b.page_number
+        && a.contexts[0] == b.contexts[0]
+        && a.contexts[1] == b.contexts[1]
+        && a.contexts[2] == b.contexts[2];
+}
+
+layout_state_t typesetter_t::save_state() {
+    layout_state_t state;
+    state.page_number = target.page_number;
+    state.contexts[0] = title.save_state();
+    state.contexts[1] = chap.save_state();
+    state.contexts[2] = text.save_state();
+    return state;
+}
+
+// Picks up layout at a saved state on a fresh target, ready to typeset the
+// paragraph next.  The page is reopened (with only its page number on it)
+// unless next opens its own.
+void typesetter_t::resume(const layout_state_t & state, const para_t & next) {
+    if (opens_page(next)) target.page_number = state.page_number;
+    else {
+        target.page_number = state.page_number - 1;
+        target.new_page();
+    }
+
+    title.restore_state(state.contexts[0]);
+    chap.restore_state(state.contexts[1]);
+    text.restore_state(state.contexts[2]);
+}
+
+void typesetter_t::typeset(const para_t & para, vector<float> * token_sizes) {
+    title.token_sizes = token_sizes;
+    chap.token_sizes = token_sizes;
+    text.token_sizes = token_sizes;
+
+    // headings name their chapter on the timeline
+    TRACE_SPAN("paragraph", target.page_number,
+               para.kind == HEADING_PARA ? para.text.c_str() : nullptr);
+
+    switch (para.kind) {
+    case TITLE_PARA:
+        title.render_columns(para.text);
+        break;
+    case HEADING_PARA:
+        target.new_page();
+        chap.render_columns(para.text);
+        text.set_column(3);
+        break;
+    case DIVIDER_PARA:
+        text.render_column_divider();
+        break;
+    case BODY_PARA:
+        text.render_columns(para.text);
+        break;
+    case KEY_PAGE:
+        target.new_page();
+        {
+            keypage_context_t kp(target);
+            kp.render_key_page();
+        }
+        break;
+    }
+}
+
+int measure_book(string input) {
+    target_t tgt(MEASURE_TARGET);
+    tgt.new_page();
+    {
+        typesetter_t ts(tgt);
+        para_reader_t reader(input);
+        para_t para;
+        while (reader.next(para)) ts.typeset(para);
+    }
+    return tgt.page_number;
+}
+
+const float COVER_BLEED = 0.125;
+const float COVER_MARGIN = 1.0;
+
+void render_back_cover(sb_t & sb) {
+    sb.draw_skull_bat(4, 5.5/2-2+COVER_BLEED, (sb.target.paper_height-3)/2);
+}
+
+// the spine keeps the lettering the cover had before it shared the book's
+// glyph code: twice the book's line width and a steeper l
+void render_spine(target_t & tgt, float spinex) {
+    sb_t spine(tgt, 3);
+    spine.line_weight = 0.01;
+    spine.el_rise = sqrt(2);
+    spine.el_halfwidth = sqrt(2)/2;
+    spine.set_skullbat_scale(3);
+
+    spine.render_at_inches("Pride and Prejudice", spinex, COVER_MARGIN/2+COVER_BLEED);
+    spine.render_at_inches("Jane Austen", spinex, 4.5+COVER_BLEED);
+
+    spine.draw_skull_bat(0.5, spinex-0.25,
+                         tgt.paper_height-COVER_MARGIN-COVER_BLEED);
+}
+
+void render_front_cover(sb_t & sb) {
+    float width = 5.5;
+    float x = sb.target.paper_width-width-COVER_BLEED;
+    float y = COVER_BLEED;
+
+    cairo_t * cr = sb.cr;
+    cairo_surface_t * art = cached_image("Final Book Cover.png");
+    cairo_save(cr);
+    int w = cairo_image_surface_get_width(art);
+    cairo_translate(cr, x, y);
+    cairo_scale(cr, width /w, width /w);
+    cairo_set_source_surface(cr, art, 0,0);
+    sb.target.paint_image(cr, "Final Book Cover.png");
+    cairo_restore(cr);
+}
+
+// the book's pages are 5.5 by 8.5 inches
+void render_cover(string filename, int npages, float paper_thickness) {
+    float spine_width = npages * paper_thickness;
+    float width = 2*COVER_BLEED + 2*5.5 + spine_width;
+    float height = 2*COVER_BLEED + 8.5;
+
+    target_t tgt(filename, width, height, COVER_MARGIN);
+    tgt.number_pages = false;
+    tgt.new_page();
+    {
+        sb_t sb(tgt);
+        render_back_cover(sb);
+        render_spine(tgt, width/2);
+        render_front_cover(sb);
+    }
+    tgt.save_and_close();
+}
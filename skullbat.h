@@ -0,0 +1,524 @@
+#pragma once
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <cairo.h>
+#include <cairo-pdf.h>
+}
+
+#include "display_list.h"
+
+using namespace std;
+
+// The skull-bat engine shared by abjad and cover: targets that draw or
+// record pages, contexts that draw phonetic words at a scale, and the
+// dictionary and tokenizer that turn text into phonetic words.
+
+void die(string message);
+float nan();
+
+const float POINTS_PER_INCH = 72.0;
+
+// bump when the drawing of any glyph changes, to drop cached drawings
+const uint32_t ENGINE_VERSION = 1;
+
+enum output_format_t {
+    CAIRO_PDF_OUTPUT,
+    NATIVE_PDF_OUTPUT,
+    SVG_OUTPUT,    // one svg file per page
+    HTML_OUTPUT,   // every page in one html file
+    PNG_OUTPUT,    // page images and/or a contact sheet
+    HPGL_OUTPUT,   // one plotter file per page
+    GCODE_OUTPUT,
+};
+
+// chosen on the command line
+extern output_format_t output_format;
+extern float png_dpi;
+extern bool png_pages;
+extern bool png_contact_sheet;
+
+// set by --watch, where rebuild time matters more than file size
+extern bool fast_pdf;
+
+// a writer for recorded pages in the output format
+page_sink_t * open_sink(string filename, float width=5.5, float height=8.5);
+
+enum target_kind_t {
+    PDF_TARGET,       // draw straight onto a cairo pdf surface
+    RECORD_TARGET,    // capture each page as a display list for a page sink
+    MEASURE_TARGET,   // lay out only, nothing is drawn
+};
+
+struct skullbat_context_t;
+struct skullbat_justification_context_t;
+struct target_t {
+    target_kind_t kind;
+
+    // the pdf surface, or a scratch surface that only builds paths when
+    // recording, or null when measuring
+    cairo_surface_t * csurf;
+
+    page_sink_t * sink = nullptr;
+    bool mark_glyphs = false;   // bracket each word's ops in the display list
+    unique_ptr<page_sink_t> owned_sink;   // when writing a file through a sink
+    display_list_t dl;   // current page when recording
+
+    float paper_width;
+    float paper_height;
+
+    float margin;
+
+    skullbat_context_t * pn;   // for rendering page number
+    bool number_pages = true;
+    int page_number = 0;
+    bool page_open = false;
+
+    // only pages in this range are drawn, the rest are just laid out
+    int first_drawn = 1;
+    int last_drawn = numeric_limits<int>::max();
+    bool drawing = false;   // whether the open page is drawn
+
+    set<skullbat_justification_context_t *> sbj_contexts;
+
+    // targets start with no page open, the first new_page() opens
+    // page_number+1
+    target_t(string filename, float newwidth=5.5, float newheight=8.5,
+             float newmargin=1.0);
+    target_t(target_kind_t newkind, page_sink_t * newsink=nullptr,
+             float newwidth=5.5, float newheight=8.5, float newmargin=1.0);
+    // draws straight onto surface, which it takes over: save_and_close
+    // finishes and releases it
+    target_t(cairo_surface_t * surface, float newwidth=5.5,
+             float newheight=8.5, float newmargin=1.0);
+
+    ~target_t();
+
+    void init(float newwidth, float newheight, float newmargin);
+
+    void new_page_subscribe(skullbat_justification_context_t * sbj);
+    void new_page_unsubscribe(skullbat_justification_context_t * sbj);
+
+    void new_page();
+    void finish_page();
+    void discard_page();
+    void mark_page_number();
+
+    void stroke(cairo_t * cr);
+    void fill(cairo_t * cr);
+    void paint_image(cairo_t * cr, string name);
+    void show_text(cairo_t * cr, string text);
+    void begin_glyph(cairo_t * cr, string key, float x, float y);
+    void end_glyph();
+    void draw_fragment(const display_list_t & fragment);
+
+    void save_and_close();
+
+};
+
+// where a justification context is in its page, enough to resume layout
+struct context_state_t {
+    int cur_row;
+    int cur_col;
+    bool need_fresh_column;
+    bool emphasis;
+};
+
+bool operator==(const context_state_t & a, const context_state_t & b);
+
+// A paragraph's words packed end to end in one string, each found by where
+// it ends, so splitting and phoneticizing a paragraph fills two buffers
+// instead of making a string for every word.
+struct word_list_t {
+    string chars;
+    vector<uint32_t> ends;
+
+    size_t size() const;
+    bool empty() const;
+    string operator[](size_t ix) const;
+    bool is(size_t ix, char c) const;   // whether word ix is just c
+    void push_back(const string & w);
+};
+
+struct vowel_space_t {
+    float before;
+    float after;
+};
+
+struct skullbat_context_t {
+    target_t & target;
+    cairo_t * cr;
+
+    float scale;
+
+    // the stroke width per unit of scale, and the l stroke's rise and half
+    // width per step, as set_skullbat_scale applies them; the book's
+    // proportions unless changed before calling it again
+    double line_weight = 0.01/2;
+    double el_rise = 2/sqrt(5);
+    double el_halfwidth = 2/sqrt(5);
+
+    float unit;
+    float word_width;
+
+    float step;
+    float halfstep;
+    float ribstep;
+    float vowelstep;
+    float wordstep;
+
+    float elstep;
+    float eldx;
+
+    float hookrad;
+    float dotrad;
+    float voicedlen;
+
+    float vowel_size;
+
+    float leftx;
+    float spinex;
+    float rightx;
+    float markx;
+
+    float starty;
+    float riby;
+
+    bool emphasis = false;
+
+    // the ten digits drawn at the origin, for composing page numbers
+    vector<cairo_path_t *> digit_paths;
+
+    skullbat_context_t(target_t & newtgt, float newscale=1.0)
+            : target(newtgt) {
+
+        // measuring targets have no surface, so contexts on them must not draw
+        cr = nullptr;
+        if (target.csurf) {
+            cr = cairo_create(target.csurf);
+            cairo_scale(cr, POINTS_PER_INCH, POINTS_PER_INCH);
+
+            cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+            cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+            cairo_set_source_rgb(cr, 0,0,0);
+        }
+
+        set_skullbat_scale(newscale);
+    }
+
+    ~skullbat_context_t() {
+        for (cairo_path_t * path : digit_paths) cairo_path_destroy(path);
+        if (cr) cairo_destroy(cr);
+    }
+
+    void stroke() { target.stroke(cr); }
+    void fill() { target.fill(cr); }
+
+    void set_skullbat_scale(float newscale);
+    void render_at_inches(string text, float x, float y);
+    void draw_skull_bat(float width, float x, float y);
+    void build_digit_paths();
+    void render_number_at_inches(int n, float x, float y);
+    void render_voice_mark(float offset);
+    float size_consonant(char c);
+    void render_consonant(char c);
+    vowel_space_t vowel_space(char c);
+    float size_vowel_hook();
+    void render_vowel_hook();
+    void render_monopthong(char c, float x, float y);
+    void render_i_dipthong(char c, float x, float y);
+    void render_u_dipthong(char c, float x, float y);
+    float size_logogram_word(string w);
+    void render_logogram_word(string w);
+    float size_vowel_word(string w);
+    void render_vowel_word(string w);
+    float size_digit(char c);
+    void render_digit(char c);
+    float size_numeral(string w);
+    void render_numeral(string w);
+    void render_vowel(string v, float x, float y);
+    float size_punct(string w);
+    void render_punct(string w);
+    float size_phonetic_word(string w);
+    void render_phonetic_word(string w);
+    void render_phonetic_words(const word_list_t & ws, size_t first, size_t last);
+};
+
+using sb_t = skullbat_context_t;
+
+struct skullbat_justification_context_t : skullbat_context_t {
+    const float SEP_LINE_WIDTH = 0.01/2;
+    const float COLUMN_SPACING = 1.25;
+
+    cairo_t * scr;   // separator cairo context
+
+    float rows_per_page;
+    float inner_row_height;
+    float column_height;
+
+    float colstep;
+    int ncols;
+
+    bool need_fresh_column;
+
+    // these are origin 1
+    int cur_col;
+    int cur_row;
+
+    // if set, render_columns() appends the size of each word it places
+    vector<float> * token_sizes = nullptr;
+
+    // layout statistics, counting only rows and columns that hold words
+    int columns_filled = 0;
+    int rows_filled = 0;
+    int words_placed = 0;
+    int last_filled_page = 0;
+    int last_filled_row = 0;
+
+    skullbat_justification_context_t(target_t & newtgt, float newscale=1.0,
+                                     int newrows=2)
+            : skullbat_context_t(newtgt, newscale) {
+        newtgt.new_page_subscribe(this);
+
+        scr = nullptr;
+        if (target.csurf) {
+            scr = cairo_create(target.csurf);
+            cairo_scale(scr, POINTS_PER_INCH, POINTS_PER_INCH);
+            cairo_set_line_width(scr, SEP_LINE_WIDTH);
+            cairo_set_line_cap(scr, CAIRO_LINE_CAP_SQUARE);
+            cairo_set_line_join(scr, CAIRO_LINE_JOIN_ROUND);
+            cairo_set_source_rgb(scr, 0.5,0.5,0.5);
+        }
+
+        set_column_scale(newscale);
+        set_row_count(newrows);
+        first_row();
+    }
+
+    ~skullbat_justification_context_t() {
+        target.new_page_unsubscribe(this);
+        if (scr) cairo_destroy(scr);
+    }
+
+    void set_column_scale(float newscale);
+    void set_row_count(int newrows);
+    void set_column(int newcol);
+    void next_column();
+    void render_row_separator(int row);
+    void first_row();
+    void next_row();
+    void handle_new_page();
+    void render_column_divider();
+    void place_column(const word_list_t & ws, size_t first, size_t last);
+    void render_columns(string text);
+
+    context_state_t save_state();
+    void restore_state(const context_state_t & state);
+};
+
+using sbj_t = skullbat_justification_context_t;
+
+//TODO change this from struct to bare functions
+struct keypage_context_t : skullbat_context_t {
+    const float FONT_SIZE = 12.0;
+
+    void render_latin(string text, float x, float y);
+    void render_skullbat(string text, float x, float y);
+    void render_key_page();
+    void draw_key_page();
+
+    keypage_context_t(target_t & newtgt, float newscale=1.0)
+            : skullbat_context_t(newtgt, newscale) {
+    }
+};
+
+using kp_t = keypage_context_t;
+
+struct collect_sink_t : page_sink_t {
+    vector<recorded_page_t> pages;
+
+    void add_page(recorded_page_t & page) {
+        pages.push_back(recorded_page_t());
+        pages.back().page_number = page.page_number;
+        swap(pages.back().dl, page.dl);
+    }
+};
+
+// replays recorded pages onto a cairo pdf surface
+// a cairo write function appending to the string closure points to
+cairo_status_t append_to_string(void * closure, const unsigned char * data,
+                                unsigned int length);
+
+struct pdf_sink_t : page_sink_t {
+    cairo_surface_t * csurf;
+
+    pdf_sink_t(string filename, float width=5.5, float height=8.5) {
+        csurf = cairo_pdf_surface_create(filename.c_str(),
+                                         width * POINTS_PER_INCH,
+                                         height * POINTS_PER_INCH);
+    }
+
+    // the pdf is appended to bytes
+    pdf_sink_t(string * bytes, float width=5.5, float height=8.5) {
+        csurf = cairo_pdf_surface_create_for_stream(append_to_string, bytes,
+                                                    width * POINTS_PER_INCH,
+                                                    height * POINTS_PER_INCH);
+    }
+
+    void add_page(recorded_page_t & page) {
+        cairo_t * cr = cairo_create(csurf);
+        page.dl.replay(cr);
+        cairo_destroy(cr);
+        cairo_surface_show_page(csurf);
+    }
+
+    void finish() {
+        cairo_surface_finish(csurf);
+        cairo_surface_destroy(csurf);
+    }
+};
+
+// png files are decoded once per thread and shared by its drawing
+cairo_surface_t * cached_image(string name);
+
+// word -> phonetic spelling, from pronunciation.txt
+extern map<string, string> pronunciation;
+
+void load_phonetic();
+void load_extras();
+
+word_list_t split_words(const string & text);
+string pronunciation_key(string raw_w);
+string phoneticize_word(string raw_w);
+word_list_t phoneticize_words(const word_list_t & ws);
+
+// a phonetic spelling's vowels, one per entry (diphthongs are two chars)
+vector<string> split_vowels(string text);
+
+// binary files of plain values and display lists
+
+template <typename T>
+void write_pod(ostream & out, const T & value) {
+    out.write((const char *) & value, sizeof value);
+}
+
+template <typename T>
+bool read_pod(istream & in, T & value) {
+    return (bool) in.read((char *) & value, sizeof value);
+}
+
+template <typename T>
+void write_pods(ostream & out, const vector<T> & values) {
+    write_pod(out, (uint64_t) values.size());
+    out.write((const char *) values.data(), values.size() * sizeof (T));
+}
+
+// what is left of a file stream, so a corrupt count can be caught before
+// it is used to size anything
+inline uint64_t bytes_left(istream & in) {
+    streampos here = in.tellg();
+    in.seekg(0, ios::end);
+    streampos end = in.tellg();
+    in.seekg(here);
+    return here < 0 || end < here ? 0 : (uint64_t) (end - here);
+}
+
+template <typename T>
+bool read_pods(istream & in, vector<T> & values) {
+    uint64_t n;
+    if (! read_pod(in, n)) return false;
+    if (n > bytes_left(in) / sizeof (T)) return false;
+    values.resize(n);
+    return (bool) in.read((char *) values.data(), n * sizeof (T));
+}
+
+// false if the stream is short, or holds an op whose verbs, coords or name
+// fall outside the arrays
+void write_display_list(ostream & out, const display_list_t & dl);
+bool read_display_list(istream & in, display_list_t & dl);
+
+// 64-bit FNV-1a
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t hash_bytes(const void * bytes, size_t n, uint64_t hash=FNV_OFFSET);
+uint64_t hash_bytes(const string & bytes, uint64_t hash=FNV_OFFSET);
+
+// books
+
+const string STARS = "* * * * *";
+
+enum para_kind_t {
+    TITLE_PARA,
+    HEADING_PARA,
+    DIVIDER_PARA,
+    BODY_PARA,
+    KEY_PAGE,
+};
+struct para_t {
+    para_kind_t kind;
+    string text;
+};
+// Reads a book a paragraph at a time, classifying each as it is read, and
+// ends with the key page.  Paragraphs are separated by blank lines, and
+// their lines are joined with spaces.
+struct para_reader_t {
+    ifstream in;
+    string line;   // reused for every line
+    bool title_page = true;
+    bool at_end = false;
+    bool done = false;
+
+    para_reader_t(string filename) : in(filename) {}
+
+    // reuses para's storage; false once the key page has been read
+    bool next(para_t & para);
+};
+// the layout state between two paragraphs
+struct layout_state_t {
+    int page_number;
+    context_state_t contexts[3];   // title, chap, text
+};
+struct typesetter_t {
+    target_t & target;
+
+    sbj_t title;
+    sbj_t chap;
+    sbj_t text;
+
+    typesetter_t(target_t & tgt)
+            : target(tgt), title(tgt, 7, 1), chap(tgt, 2), text(tgt) {
+    }
+
+    void typeset(const para_t & para, vector<float> * token_sizes=nullptr);
+
+    layout_state_t save_state();
+    void resume(const layout_state_t & state, const para_t & next);
+};
+
+para_kind_t classify_para(const string & para);
+vector<para_t> load_book(string filename);
+bool opens_page(const para_t & para);
+bool operator==(const layout_state_t & a, const layout_state_t & b);
+
+// the number of pages in the book at input, from a layout pass that draws
+// nothing
+int measure_book(string input);
+
+// covers
+
+// white paper, in inches per page
+const float DEFAULT_PAPER_THICKNESS = 0.002252;
+
+// Draws the wraparound cover for a book of npages pages: the back cover,
+// a spine as thick as the pages, and the front cover, with bleed around
+// the outside.
+void render_cover(string filename, int npages, float paper_thickness);
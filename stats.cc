@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "stats.h"
+
+using namespace std;
+
+long peak_rss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (! GetProcessMemoryInfo(GetCurrentProcess(), & counters, sizeof counters)) return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, & usage);
+    return usage.ru_maxrss;
+#endif
+}
+
+#ifdef SKULLBAT_STATS
+
+stage_stats_t stage_stats[NSTAGES];
+atomic<uint64_t> stats_tokens(0);
+atomic<uint64_t> stats_pages(0);
+
+static const chrono::steady_clock::time_point stats_start = chrono::steady_clock::now();
+
+#ifdef SKULLBAT_ALLOCS
+
+// NSTAGES for allocations made outside every stage
+static thread_local int current_stage = NSTAGES;
+
+// bytes allocated on a thread less those of them freed, on any thread.
+// Each block points to its thread's count, so a free on another thread is
+// taken off the thread that allocated it; counts are never freed, since
+// blocks can outlive their thread.
+struct thread_heap_t {
+    atomic<int64_t> live;
+};
+
+static thread_local thread_heap_t * thread_heap = nullptr;
+
+// the most thread_heap has held since the innermost stage began
+static thread_local int64_t thread_peak = 0;
+
+static thread_heap_t * own_heap() {
+    if (! thread_heap) {
+        void * p = malloc(sizeof(thread_heap_t));
+        if (! p) abort();
+        thread_heap = new (p) thread_heap_t();
+    }
+    return thread_heap;
+}
+
+struct alloc_stats_t {
+    atomic<uint64_t> count;
+    atomic<uint64_t> bytes;
+    atomic<uint64_t> high_water;   // most of one call's own live bytes
+    atomic<uint64_t> rss_growth;   // KB, summed over calls
+};
+
+static alloc_stats_t alloc_stats[NSTAGES + 1];
+
+static void raise_to(atomic<uint64_t> & value, uint64_t to) {
+    uint64_t old = value;
+    while (old < to && ! value.compare_exchange_weak(old, to));
+}
+
+// each block starts with its size and its thread's count, which also
+// keeps the caller's alignment
+struct alloc_header_t {
+    size_t size;
+    thread_heap_t * owner;
+};
+
+static const size_t ALLOC_HEADER = 16;
+static_assert(sizeof(alloc_header_t) <= ALLOC_HEADER, "alloc header too big");
+
+static void * tracked_alloc(size_t size) {
+    char * block = (char *) malloc(size + ALLOC_HEADER);
+    if (! block) return nullptr;
+    thread_heap_t * heap = own_heap();
+    * (alloc_header_t *) block = alloc_header_t{size, heap};
+
+    alloc_stats_t & stats = alloc_stats[current_stage];
+    stats.count += 1;
+    stats.bytes += size;
+    int64_t live = heap->live += size;
+    if (live > thread_peak) thread_peak = live;
+
+    return block + ALLOC_HEADER;
+}
+
+static void tracked_free(void * p) {
+    if (! p) return;
+    char * block = (char *) p - ALLOC_HEADER;
+    alloc_header_t * header = (alloc_header_t *) block;
+    header->owner->live -= header->size;
+    free(block);
+}
+
+void * operator new(size_t size) {
+    void * p = tracked_alloc(size);
+    if (! p) throw bad_alloc();
+    return p;
+}
+
+void * operator new[](size_t size) {
+    void * p = tracked_alloc(size);
+    if (! p) throw bad_alloc();
+    return p;
+}
+
+void * operator new(size_t size, const nothrow_t &) noexcept {
+    return tracked_alloc(size);
+}
+
+void * operator new[](size_t size, const nothrow_t &) noexcept {
+    return tracked_alloc(size);
+}
+
+void operator delete(void * p) noexcept {
+    tracked_free(p);
+}
+
+void operator delete[](void * p) noexcept {
+    tracked_free(p);
+}
+
+void operator delete(void * p, const nothrow_t &) noexcept {
+    tracked_free(p);
+}
+
+void operator delete[](void * p, const nothrow_t &) noexcept {
+    tracked_free(p);
+}
+
+#endif
+
+struct stage_info_t {
+    const char * name;
+    bool per_token;   // report tokens_per_second
+    bool per_page;    // report pages_per_second
+    bool per_word;    // called for each word, too often to sample RSS
+};
+
+static const stage_info_t stage_info[NSTAGES] = {
+    {"load_phonetic", false, false, false},
+    {"read_paragraph", false, false, false},
+    {"split_words", true, false, false},
+    {"phoneticize_words", true, false, false},
+    {"size_phonetic_word", true, false, true},
+    {"render_phonetic_words", true, false, false},
+    {"new_page", false, true, false},
+    {"save_and_close", false, false, false},
+};
+
+#ifdef SKULLBAT_ALLOCS
+// getrusage is a system call, so RSS is sampled only around the calls that
+// aren't per word and aren't inside another stage
+bool stage_timer_t::samples_rss() const {
+    return outer_stage == NSTAGES && ! stage_info[stage].per_word;
+}
+#endif
+
+stage_timer_t::stage_timer_t(stage_t newstage)
+    : stage(newstage), start(chrono::steady_clock::now()) {
+#ifdef SKULLBAT_ALLOCS
+    outer_stage = current_stage;
+    current_stage = stage;
+    start_live = own_heap()->live;
+    outer_peak = thread_peak;
+    thread_peak = start_live;
+    if (samples_rss()) start_rss = peak_rss();
+#endif
+}
+
+stage_timer_t::~stage_timer_t() {
+    auto elapsed = chrono::steady_clock::now() - start;
+    stage_stats[stage].nanoseconds += chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+    stage_stats[stage].calls += 1;
+
+#ifdef SKULLBAT_ALLOCS
+    current_stage = outer_stage;
+    raise_to(alloc_stats[stage].high_water, thread_peak - start_live);
+    thread_peak = max(thread_peak, outer_peak);   // the outer stage saw it too
+    if (samples_rss()) alloc_stats[stage].rss_growth += peak_rss() - start_rss;
+#endif
+}
+
+bool stats_enabled() {
+    return true;
+}
+
+// throughput if the whole run had taken only this long
+static double per_second(uint64_t n, double seconds) {
+    return seconds > 0 ? n / seconds : 0;
+}
+
+#ifdef SKULLBAT_ALLOCS
+static void write_alloc_json(ostream & out, int stage) {
+    out << "\"allocs\": " << alloc_stats[stage].count
+        << ", \"alloc_bytes\": " << alloc_stats[stage].bytes;
+}
+#endif
+
+void write_stats_json(ostream & out) {
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - stats_start).count();
+    uint64_t tokens = stats_tokens;
+    uint64_t pages = stats_pages;
+
+    out << fixed << setprecision(6);
+    out << "{\n";
+    out << "  \"wall_seconds\": " << wall << ",\n";
+    out << "  \"tokens\": " << tokens << ",\n";
+    out << "  \"pages\": " << pages << ",\n";
+    out << "  \"tokens_per_second\": " << per_second(tokens, wall) << ",\n";
+    out << "  \"pages_per_second\": " << per_second(pages, wall) << ",\n";
+#ifdef SKULLBAT_ALLOCS
+    out << "  \"peak_rss_kb\": " << peak_rss() << ",\n";
+    out << "  \"outside_stages\": {";
+    write_alloc_json(out, NSTAGES);
+    out << "},\n";
+#endif
+    out << "  \"stages\": {\n";
+    for (int i = 0; i < NSTAGES; i++) {
+        double seconds = stage_stats[i].nanoseconds / 1e9;
+        out << "    \"" << stage_info[i].name << "\": {"
+            << "\"seconds\": " << seconds
+            << ", \"calls\": " << stage_stats[i].calls;
+        if (stage_info[i].per_token) out << ", \"tokens_per_second\": " << per_second(tokens, seconds);
+        if (stage_info[i].per_page) out << ", \"pages_per_second\": " << per_second(pages, seconds);
+#ifdef SKULLBAT_ALLOCS
+        out << ", ";
+        write_alloc_json(out, i);
+        out << ", \"heap_high_water_bytes\": " << alloc_stats[i].high_water
+            << ", \"peak_rss_growth_kb\": " << alloc_stats[i].rss_growth;
+#endif
+        out << "}" << (i + 1 < NSTAGES ? "," : "") << "\n";
+    }
+    out << "  }\n";
+    out << "}\n";
+    out << defaultfloat;
+}
+
+#else
+
+bool stats_enabled() {
+    return false;
+}
+
+void write_stats_json(ostream &) {
+}
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <ostream>
+
+using namespace std;
+
+// Per-stage timing, built in only with -DSKULLBAT_STATS (make STATS=1).
+// Without it STAGE_TIMER and COUNT_TOKENS/COUNT_PAGES expand to nothing, so
+// ordinary builds carry no timers at all.  Stage times are inclusive (a
+// stage called from another counts in both) and summed over threads.
+// Tokens are words phoneticized, so modes that lay a paragraph out twice
+// count its words twice; pages are pages drawn.  Only the stages that work
+// through tokens or pages report a throughput.
+//
+// -DSKULLBAT_ALLOCS (make ALLOCS=1) also replaces the global operator new
+// and delete to charge each allocation to the innermost stage running on
+// its thread, and adds to the report allocation counts and bytes, the most
+// heap a single call held on top of what its thread had at entry
+// (heap_high_water_bytes, inclusive like the times; a block freed on
+// another thread still counts against the thread that allocated it), and
+// how far the process's peak RSS rose between entry and exit, summed over
+// calls (peak_rss_growth_kb; only sampled for calls made outside any other
+// stage and not once per word, so it is 0 for size_phonetic_word and for
+// stages that only run nested, and RSS is per process, so with --parallel
+// it is charged to every stage running when it rises).
+
+enum stage_t {
+    STAGE_LOAD_PHONETIC,
+    STAGE_READ_PARAGRAPH,
+    STAGE_SPLIT_WORDS,
+    STAGE_PHONETICIZE_WORDS,
+    STAGE_SIZE_PHONETIC_WORD,
+    STAGE_RENDER_PHONETIC_WORDS,
+    STAGE_NEW_PAGE,
+    STAGE_SAVE_AND_CLOSE,
+    NSTAGES,
+};
+
+#ifdef SKULLBAT_STATS
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct stage_stats_t {
+    atomic<uint64_t> nanoseconds;
+    atomic<uint64_t> calls;
+};
+
+extern stage_stats_t stage_stats[NSTAGES];
+extern atomic<uint64_t> stats_tokens;
+extern atomic<uint64_t> stats_pages;
+
+// adds the time from construction to destruction to its stage
+struct stage_timer_t {
+    stage_t stage;
+    chrono::steady_clock::time_point start;
+#ifdef SKULLBAT_ALLOCS
+    int outer_stage;
+    int64_t start_live;   // thread's live heap bytes at entry
+    int64_t outer_peak;
+    long start_rss;       // peak RSS at entry, KB
+
+    bool samples_rss() const;
+#endif
+
+    stage_timer_t(stage_t newstage);
+    ~stage_timer_t();
+};
+
+#define STATS_CONCAT2(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT2(a, b)
+#define STAGE_TIMER(stage) stage_timer_t STATS_CONCAT(stage_timer_, __LINE__)(stage)
+#define COUNT_TOKENS(n) (stats_tokens += (n))
+#define COUNT_PAGES(n) (stats_pages += (n))
+
+#else
+
+#define STAGE_TIMER(stage) ((void) 0)
+#define COUNT_TOKENS(n) ((void) 0)
+#define COUNT_PAGES(n) ((void) 0)
+
+#endif
+
+// the process's peak resident set so far, in KB
+long peak_rss();
+
+// true when the timers were compiled in
+bool stats_enabled();
+
+// the stage totals as one json object, with the wall time since startup
+void write_stats_json(ostream & out);
@@ -0,0 +1,227 @@
+#include <iostream>
+
+#include "pdf_writer.h"
+#include "svg_writer.h"
+
+using namespace std;
+
+const float POINTS_PER_INCH = 72.0;
+
+// the caps and joins used by nearly every stroke, set once on each page
+const int DEFAULT_CAP = 1;    // CAIRO_LINE_CAP_ROUND
+const int DEFAULT_JOIN = 1;   // CAIRO_LINE_JOIN_ROUND
+
+const char * CAP_NAMES[] = {"butt", "round", "square"};
+const char * JOIN_NAMES[] = {"miter", "round", "bevel"};
+
+void append_color(string & s, float red, float green, float blue) {
+    const char * hex = "0123456789abcdef";
+    s.push_back('#');
+    for (float v : {red, green, blue}) {
+        int n = v * 255 + 0.5;
+        s.push_back(hex[n >> 4]);
+        s.push_back(hex[n & 15]);
+    }
+}
+
+// width and height of a png in pixels, from its header
+pair<int, int> png_size(string name) {
+    ifstream in(name, ios::binary);
+    unsigned char header[24];
+    if (! in.read((char *) header, sizeof(header))) return {0, 0};
+
+    int width = header[16] << 24 | header[17] << 16 | header[18] << 8 | header[19];
+    int height = header[20] << 24 | header[21] << 16 | header[22] << 8 | header[23];
+    return {width, height};
+}
+
+svg_writer_t::svg_writer_t(string newfilename, bool newhtml, float width,
+                           float height) {
+    filename = newfilename;
+    html = newhtml;
+    paper_width = width * POINTS_PER_INCH;
+    paper_height = height * POINTS_PER_INCH;
+
+    if (html) {
+        out.open(filename, ios::binary);
+        out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">"
+            << "<title>" << filename << "</title><style>"
+            << "body{background:#ccc}"
+            << "svg{display:block;margin:1em auto;background:#fff}"
+            << "</style></head><body>\n";
+    }
+}
+
+void svg_writer_t::add_page(recorded_page_t & rp) {
+    build_page(rp);
+
+    if (html) out.write(page.data(), page.size());
+    else {
+        size_t dot = filename.rfind('.');
+        string stem = dot == string::npos ? filename : filename.substr(0, dot);
+        ofstream svg(stem + "-" + to_string(rp.page_number) + ".svg", ios::binary);
+        svg.write(page.data(), page.size());
+    }
+}
+
+void svg_writer_t::build_page(const recorded_page_t & rp) {
+    const display_list_t & dl = rp.dl;
+
+    // separate svg files can't share symbols
+    if (! html) symbols.clear();
+
+    page = "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+           "xmlns:xlink=\"http://www.w3.org/1999/xlink\"";
+    if (html) page += " id=\"page-" + to_string(rp.page_number) + "\"";
+    page += " width=\"";
+    append_number(page, paper_width / POINTS_PER_INCH);
+    page += "in\" height=\"";
+    append_number(page, paper_height / POINTS_PER_INCH);
+    page += "in\" viewBox=\"0 0 ";
+    append_number(page, paper_width);
+    page += " ";
+    append_number(page, paper_height);
+    page += "\">\n<g fill=\"none\" stroke=\"#000\" stroke-linecap=\"";
+    page += CAP_NAMES[DEFAULT_CAP];
+    page += "\" stroke-linejoin=\"";
+    page += JOIN_NAMES[DEFAULT_JOIN];
+    page += "\">\n";
+
+    for (size_t ix = 0; ix < dl.ops.size(); ix += 1) {
+        const dl_op_t & op = dl.ops[ix];
+
+        if (op.kind == DL_IMAGE) {
+            write_image(dl, op);
+            continue;
+        }
+        // the outline inside text markers is written as plain paths
+        if (op.kind == DL_END_GLYPH || op.kind == DL_BEGIN_TEXT
+            || op.kind == DL_END_TEXT) {
+            continue;
+        }
+        if (op.kind != DL_BEGIN_GLYPH) {
+            write_path(dl, op, 0, 0);
+            continue;
+        }
+
+        // the glyph's ops run up to its end marker
+        size_t end = ix + 1;
+        while (end < dl.ops.size() && dl.ops[end].kind != DL_END_GLYPH) end += 1;
+
+        float x = dl.coords[op.first_coord];
+        float y = dl.coords[op.first_coord + 1];
+
+        const string & key = dl.names[op.name];
+        auto found = symbols.find(key);
+        int symbol;
+        if (found != symbols.end()) symbol = found->second;
+        else {
+            symbol = symbols.size();
+            symbols[key] = symbol;
+
+            page += "<symbol id=\"g" + to_string(symbol) + "\" overflow=\"visible\">\n";
+            for (size_t jx = ix + 1; jx < end; jx += 1) {
+                if (dl.ops[jx].kind == DL_IMAGE) continue;
+                write_path(dl, dl.ops[jx], -x, -y);
+            }
+            page += "</symbol>\n";
+        }
+
+        page += "<use xlink:href=\"#g" + to_string(symbol) + "\" x=\"";
+        append_number(page, x);
+        page += "\" y=\"";
+        append_number(page, y);
+        page += "\"/>\n";
+
+        ix = end;
+    }
+
+    page += "</g>\n</svg>\n";
+}
+
+// dx, dy moves the path, to put a glyph's origin at 0,0 in its symbol
+void svg_writer_t::write_path(const display_list_t & dl, const dl_op_t & op,
+                              float dx, float dy) {
+    const float * c = & dl.coords[op.first_coord];
+
+    page += "<path d=\"";
+    for (uint32_t ix = 0; ix < op.nverbs; ix += 1) {
+        int npoints = 0;
+        switch (dl.verbs[op.first_verb + ix]) {
+        case DL_MOVE_TO:
+            page += "M";
+            npoints = 1;
+            break;
+        case DL_LINE_TO:
+            page += "L";
+            npoints = 1;
+            break;
+        case DL_CURVE_TO:
+            page += "C";
+            npoints = 3;
+            break;
+        case DL_CLOSE_PATH:
+            page += "Z";
+            break;
+        }
+        for (int point = 0; point < npoints; point += 1) {
+            if (point) page += " ";
+            append_number(page, c[0] + dx);
+            page += " ";
+            append_number(page, c[1] + dy);
+            c += 2;
+        }
+    }
+    page += "\"";
+
+    bool black = op.red == 0 && op.green == 0 && op.blue == 0;
+    if (op.kind == DL_STROKE) {
+        page += " stroke-width=\"";
+        append_number(page, op.line_width);
+        page += "\"";
+        if (! black) {
+            page += " stroke=\"";
+            append_color(page, op.red, op.green, op.blue);
+            page += "\"";
+        }
+        if (op.line_cap != DEFAULT_CAP) {
+            page += " stroke-linecap=\"" + string(CAP_NAMES[op.line_cap]) + "\"";
+        }
+        if (op.line_join != DEFAULT_JOIN) {
+            page += " stroke-linejoin=\"" + string(JOIN_NAMES[op.line_join]) + "\"";
+        }
+    }
+    else {
+        page += " stroke=\"none\" fill=\"";
+        append_color(page, op.red, op.green, op.blue);
+        page += "\"";
+    }
+    page += "/>\n";
+}
+
+void svg_writer_t::write_image(const display_list_t & dl, const dl_op_t & op) {
+    const string & name = dl.names[op.name];
+    if (! image_sizes.count(name)) image_sizes[name] = png_size(name);
+    pair<int, int> size = image_sizes[name];
+    if (! size.first) {
+        cout << "can't read png: " << name << endl;
+        return;
+    }
+
+    const float * c = & dl.coords[op.first_coord];
+    page += "<image width=\"" + to_string(size.first) + "\" height=\""
+        + to_string(size.second) + "\" xlink:href=\"" + name
+        + "\" transform=\"matrix(";
+    for (int ix = 0; ix < 6; ix += 1) {
+        if (ix) page += " ";
+        append_number(page, c[ix], 5);
+    }
+    page += ")\"/>\n";
+}
+
+void svg_writer_t::finish() {
+    if (! html) return;
+
+    out << "</body></html>\n";
+    out.close();
+}
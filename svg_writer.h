@@ -0,0 +1,41 @@
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "display_list.h"
+
+using namespace std;
+
+// Writes recorded pages as svg, either one file per page or every page in
+// one html file.  Each distinct glyph is written once as a <symbol> and
+// placed with <use>; symbols are shared by the whole html file, but each
+// svg file defines the ones it uses.
+
+struct svg_writer_t : page_sink_t {
+    string filename;
+    bool html;
+    ofstream out;   // the html file
+
+    float paper_width;    // in points
+    float paper_height;
+
+    map<string, int> symbols;   // glyph key to symbol number
+    map<string, pair<int, int>> image_sizes;   // png file name to pixels
+
+    string page;   // scratch for the page being written
+
+    svg_writer_t(string newfilename, bool newhtml, float width=5.5,
+                 float height=8.5);
+
+    void add_page(recorded_page_t & page);
+    void finish();
+
+    // leaves rp's svg in page, without writing it
+    void build_page(const recorded_page_t & rp);
+
+    void write_path(const display_list_t & dl, const dl_op_t & op,
+                    float dx, float dy);
+    void write_image(const display_list_t & dl, const dl_op_t & op);
+};
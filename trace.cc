@@ -0,0 +1,145 @@
+#include "trace.h"
+
+using namespace std;
+
+#ifdef SKULLBAT_STATS
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+atomic<bool> tracing(false);
+
+struct trace_event_t {
+    const char * name;
+    int page;
+    string detail;
+    uint64_t start;      // in ns since start_trace()
+    uint64_t duration;
+};
+
+struct trace_buffer_t {
+    int tid;
+    vector<trace_event_t> events;
+};
+
+static string trace_filename;
+static chrono::steady_clock::time_point trace_start;
+static thread::id trace_main_thread;
+
+// every thread's buffer, kept after the thread exits; the lock is only
+// taken by a thread's first span
+static mutex buffers_mutex;
+static vector<unique_ptr<trace_buffer_t>> buffers;
+
+static thread_local trace_buffer_t * thread_buffer = nullptr;
+
+static uint64_t trace_now() {
+    auto elapsed = chrono::steady_clock::now() - trace_start;
+    return chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+}
+
+static trace_buffer_t * get_thread_buffer() {
+    if (! thread_buffer) {
+        lock_guard<mutex> lock(buffers_mutex);
+        buffers.emplace_back(new trace_buffer_t);
+        thread_buffer = buffers.back().get();
+        thread_buffer->tid = buffers.size();
+        if (this_thread::get_id() == trace_main_thread) thread_buffer->tid = 0;
+        thread_buffer->events.reserve(1 << 14);
+    }
+    return thread_buffer;
+}
+
+trace_span_t::trace_span_t(const char * newname, int newpage, const char * newdetail)
+    : name(newname), page(newpage), detail(newdetail), start(0) {
+    if (tracing) start = trace_now();
+}
+
+trace_span_t::~trace_span_t() {
+    if (! tracing) return;
+
+    trace_event_t event;
+    event.name = name;
+    event.page = page;
+    if (detail) event.detail = detail;
+    event.start = start;
+    event.duration = trace_now() - start;
+    get_thread_buffer()->events.push_back(move(event));
+}
+
+bool start_trace(string filename) {
+    trace_filename = filename;
+    trace_start = chrono::steady_clock::now();
+    trace_main_thread = this_thread::get_id();
+    tracing = true;
+    return true;
+}
+
+static void write_json_string(ostream & out, const string & s) {
+    out << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c < 0x20) out << ' ';
+        else out << c;
+    }
+    out << '"';
+}
+
+void finish_trace() {
+    if (! tracing) return;
+    tracing = false;
+
+    ofstream out(trace_filename);
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    auto separate = [&] {
+        if (! first) out << ",\n";
+        first = false;
+    };
+
+    lock_guard<mutex> lock(buffers_mutex);
+    for (auto & buffer : buffers) {
+        separate();
+        out << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": "
+            << buffer->tid << ", \"args\": {\"name\": \""
+            << (buffer->tid ? "worker " + to_string(buffer->tid) : string("main"))
+            << "\"}}";
+
+        for (trace_event_t & event : buffer->events) {
+            separate();
+            out << "{\"ph\": \"X\", \"name\": \"" << event.name
+                << "\", \"pid\": 1, \"tid\": " << buffer->tid
+                << ", \"ts\": " << event.start / 1000.0
+                << ", \"dur\": " << event.duration / 1000.0;
+            if (event.page || ! event.detail.empty()) {
+                out << ", \"args\": {";
+                if (event.page) out << "\"page\": " << event.page;
+                if (event.page && ! event.detail.empty()) out << ", ";
+                if (! event.detail.empty()) {
+                    out << "\"detail\": ";
+                    write_json_string(out, event.detail);
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+#else
+
+bool start_trace(string) {
+    return false;
+}
+
+void finish_trace() {
+}
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+// A timeline of the render in Chrome's trace-event json, for
+// chrome://tracing or ui.perfetto.dev.  Built in with the stage timers
+// (-DSKULLBAT_STATS, make STATS=1) and switched on at run time by
+// start_trace().  Each thread appends to its own buffer, so spans take no
+// lock; the buffers are written out together by finish_trace().
+
+#ifdef SKULLBAT_STATS
+
+#include <atomic>
+#include <cstdint>
+
+extern atomic<bool> tracing;
+
+// one complete ("X") event, from construction to destruction, on the
+// calling thread; page and detail become the event's args when set
+struct trace_span_t {
+    const char * name;
+    int page;
+    const char * detail;   // must outlive the span
+    uint64_t start;
+
+    trace_span_t(const char * newname, int newpage=0, const char * newdetail=nullptr);
+    ~trace_span_t();
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(...) trace_span_t TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+
+#else
+
+#define TRACE_SPAN(...) ((void) 0)
+
+#endif
+
+// false when the build has no tracing
+bool start_trace(string filename);
+
+// writes every thread's events; call once the worker threads have joined.
+// abjad calls it at exit, which --watch and --serve reach on SIGINT or
+// SIGTERM.
+void finish_trace();